@@ -0,0 +1,60 @@
+#include "DS2.h"
+#include "DS2Channel.h"
+#include "DS2ChangeTracker.h"
+#include "DS2Telemetry.h"
+// ESP32 ONLY!
+// Polls general values and pushes decoded channels to phone over Bluetooth, see DS2Telemetry.h for message format.
+//	App gets schema with channel names and then only channels that changed, K-line polling never waits for BT link.
+#include <BluetoothSerial.h>
+BluetoothSerial SerialBT;
+
+DS2 DS2(Serial2);
+
+uint8_t data[255];
+uint8_t generalValues[] = {0x12, 0x05, 0x0B, 0x03, 0x1F};
+
+// MS43 general values
+const DS2Channel msChannels[] = {
+	//	name		offset	width	flags					multiplier				addend					shift
+	{"rpm",			0,		2,		0,						1,						0,						0},
+	{"coolant",		4,		1,		0,						DS2_SCALE(0.75, 8),		DS2_SCALE(-48, 8),		8},
+	{"battery",		22,		1,		0,						DS2_SCALE(0.1, 16),		0,						16},
+};
+DS2ChannelTable table(msChannels, 3);
+DS2ChangeTracker tracker(table);
+int32_t values[3];
+
+// Queue between poll loop and BT task - samples are decimated and then dropped when it fills, never blocks
+uint8_t telemetryBuffer[4096];
+DS2Telemetry telemetry(table, telemetryBuffer, sizeof(telemetryBuffer));
+
+bool connected = false;
+
+
+void setup() {
+	Serial2.begin(9600, SERIAL_8E1);
+	Serial2.setTimeout(ISO_TIMEOUT);
+	
+	SerialBT.begin("MS4x ESP32");
+	telemetry.begin(SerialBT); // BT writes happen in background task
+	
+	tracker.setDeadband(1, DS2_SCALE(0.75, 8)); // coolant jitters by one step
+	tracker.setMaxSilence(1000); // everything at least once a second so fresh app gets all values
+}
+
+void loop(void) {
+	// New app gets schema straight away
+	if(SerialBT.hasClient() != connected) {
+		connected = !connected;
+		if(connected) {
+			telemetry.sendSchema();
+			tracker.reset();
+		}
+	}
+	
+	DS2.sendCommand(generalValues);
+	if(DS2.receiveData(data) == RECEIVE_OK) {
+		uint64_t changed = tracker.update(DS2.getFrame(), values);
+		if(changed) telemetry.push(changed, values, DS2.getFrame().getTimeStamp());
+	}
+}
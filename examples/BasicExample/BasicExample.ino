@@ -1,4 +1,5 @@
 #include "DS2.h"
+#include "DS2Command.h"
 
 // Go to libraries and paste libraries folder from this example folder
 // You can use also Adafruit library although its slower but it supports more screens - code is 100% compatible with it though!
@@ -10,9 +11,9 @@ TFT_eSPI tft = TFT_eSPI();
 // We keep data there, 255 is reccomended for full compatibility, you can use void setMaxDataLength(uint8_t dataLength) if bugs happen
 uint8_t data[255];
 
-// Format for commands is always same, see DS2.h for more info
-uint8_t ecuId[] = {0x12, 0x04, 0x00, 0x16};
-uint8_t generalValues[] = {0x12, 0x05, 0x0B, 0x03, 0x1F};
+// Format for commands is always same, see DS2.h for more info; length byte and checksum are added at compile time, see DS2Command.h
+DS2Command<4> ecuId = ds2Command<0x12, 0x00>(); // {0x12, 0x04, 0x00, 0x16}
+DS2Command<5> generalValues = ds2Command<0x12, 0x0B, 0x03>(); // {0x12, 0x05, 0x0B, 0x03, 0x1F}
 
 // Change to true if you want to calibrate LCD again
 #define REPEAT_CAL false
@@ -1,5 +1,8 @@
 #define ESP32_CUSTOM
 #include "DS2.h"
+#include "DS2Logger.h"
+#include "DS2LogCodec.h"
+#include "DS2Profile.h"
 // Go to libraries and paste libraries folder from this example folder
 // You can use also Adafruit library although its slower but it supports more screens - code is 100% compatible with it though!
 #include "SPI.h"
@@ -25,6 +28,14 @@ TFT_eSPI tft = TFT_eSPI();
 // We keep data there, 255 is reccomended for full compatibility, you can use void setMaxDataLength(uint8_t dataLength) if bugs happen
 uint8_t data[255];
 
+// Binary log - records go to RAM ring and are written to SD in 512 byte blocks in background, see DS2Logger.h
+uint8_t logBuffer[16384];
+DS2Logger logger(logBuffer, sizeof(logBuffer));
+#define LOG_PREALLOCATE (1024UL * 1024UL)
+// Records are packed against previous frame first, ~2.5x smaller; read back with DS2LogDecoder, see DS2LogCodec.h
+DS2LogEncoder packer;
+uint8_t packed[DS2_PACK_RECORD_MAX];
+
 // Format for commands is always same, see DS2.h for more info
 uint8_t ecuId[] = {0x12, 0x04, 0x00, 0x16};
 uint8_t generalValues[] = {0x12, 0x05, 0x0B, 0x03, 0x1F};
@@ -38,6 +49,11 @@ struct Ecu {
 
 uint8_t batteryOffset;
 
+// Full channel layouts for many ECU variants, made with DS2ProfileDatabase::write and copied to card, see DS2Profile.h.
+//	Only index is searched on card, list below is used if file or ECU is not there
+#define PROFILE_FILE "/profiles.bin"
+DS2Profile profile;
+
 #define ECUS_NUMBER 9
 
 const struct Ecu ecuList[ECUS_NUMBER] PROGMEM = {
@@ -143,6 +159,16 @@ void setup() {
 	
 	// Matching battery voltage offset depending on our ECU
 	batteryOffset = matchEcu(ecuIdString);
+	File profileFile = SD.open(PROFILE_FILE);
+	if(profileFile) {
+		DS2ProfileFile<File> source(profileFile);
+		DS2ProfileDatabase profiles(source);
+		if(profiles.begin() && profiles.load(ecuIdString, profile)) {
+			uint8_t battery = profile.getTable().find("battery");
+			if(battery != 255) batteryOffset = profile.getChannel(battery).offset;
+		}
+		profileFile.close();
+	}
 }
 
 // Loop variables
@@ -169,7 +195,13 @@ void loop(void) {
 
 	
 	// Receive command
-	if((DS2.receiveData(data)) == RECEIVE_OK) print = true; // do stuff if data received
+	if((DS2.receiveData(data)) == RECEIVE_OK) {
+		// do stuff if data received
+		print = true;
+		// Returns straight away, false if not logging or ring is full - encoder already moved its references then,
+		//	so next record has to start with keyframe or everything until next keyframe decodes wrong
+		if(!logger.write(packed, packer.encode(0, DS2.getFrame(), packed))) packer.reset();
+	}
 	
 	// Blocked .obtainValues - generally slower but easier to use and always laids some response
 //	if(DS2.obtainValues(generalValues, data)) print = true;
@@ -198,7 +230,7 @@ void printData(uint8_t command[]) {
 }
 
 // Handling SD card event
-String path = "/log01.csv";
+String path = "/log01.bin";
 uint8_t fileNumber = 1;
 bool sdReady = false;
 bool fileReady = false;
@@ -214,8 +246,8 @@ bool handleSDCard() {
 	} else {
 		sdReady = true;
 		if(fileReady) {
-			logToFile(file);
 			if(toggleLog) {
+				logger.end();
 				file.close();
 				fileReady = false;
 				toggleLog = false;
@@ -224,12 +256,14 @@ bool handleSDCard() {
 			file = SD.open(path.c_str());
 			while(file) {
 				String fileNumberName = String(++fileNumber);
-				path = path.substring(0, path.indexOf(".csv")-fileNumberName.length());
-				path = path + fileNumberName + ".csv";
+				path = path.substring(0, path.indexOf(".bin")-fileNumberName.length());
+				path = path + fileNumberName + ".bin";
 				file = SD.open(path.c_str());
 			}
 			if(!(file = SD.open(path.c_str(), FILE_WRITE))) return false;
-			file.println("Timestamp, Voltage, Rps, Fps");
+			logger.preallocate(file, LOG_PREALLOCATE);
+			logger.begin(file);
+			packer.reset(); // new file starts with keyframe
 			fileReady = true;
 			toggleLog = false;
 		}
@@ -242,15 +276,12 @@ bool handleSDCard() {
 	tft.println(fileReady ? "Logging" : "No logging");
 	tft.setCursor(200, 18);
 	tft.println(path);
+	tft.setCursor(200, 27);
+	tft.print(logger.getDropped());
+	tft.println(" dropped");
 	return sdReady && fileReady;
 }
 
-void logToFile(File toWrite) {
-	String logRow = String(millis()) + "," + String(batteryVoltage) 
-					+ "," + String(DS2.getRespondsPerSecond()) + "," + String(fps);
-	file.println(logRow);
-}
-
 // Very slow way of printing message, good for debugging though
 void printMessage(uint8_t array[], uint8_t length) {
 	for(uint8_t i = 0; i < 255; i++) {
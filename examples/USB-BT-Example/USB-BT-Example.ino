@@ -1,4 +1,5 @@
 #include "DS2.h" 
+#include "DS2Bridge.h"
 // ESP32 ONLY!
 // Go to libraries and paste libraries folder from this example folder
 // You can use also Adafruit library although its slower but it supports more screens - code is 100% compatible with it though!
@@ -11,9 +12,10 @@ TFT_eSPI tft = TFT_eSPI();
 BluetoothSerial SerialBT;
 
 #define TFT_TOUCH_PIN 33
-DS2 BT(SerialBT);
 DS2 USB(Serial);
 DS2 DS2(Serial2);
+// Forwards whole frames between Bluetooth and K-line, queues BT requests while bus is busy and drops echo
+DS2Bridge bridge(SerialBT, DS2);
 
 
 #define UART_SELECT 25 
@@ -21,7 +23,6 @@ DS2 DS2(Serial2);
 
 // We keep data there, 255 is reccomended for full compatibility, you can use void setMaxDataLength(uint8_t dataLength) if bugs happen
 uint8_t data[255];
-uint8_t btData[127];
 
 
 
@@ -37,9 +38,8 @@ void setup() {
 	digitalWrite(LED_SELECT, HIGH);
 	// tft.setRotation(3);	// landscape inverted
 	
-	// Changes pin select so USB communicates directly to k-line
-	pinMode(UART_SELECT, OUTPUT);
-	digitalWrite(UART_SELECT, HIGH);
+	// Changes pin select so USB communicates directly to k-line, bridge takes it LOW only while it sends BT request
+	bridge.setSelectPin(UART_SELECT, LOW);
 	
 
 	Serial2.begin(9600, SERIAL_8E1);
@@ -58,7 +58,6 @@ void setup() {
 uint32_t startTime;
 float fps, lowestFps = 0, highestFps = 0;
 bool print = false;
-bool received = false;
 
 void loop(void) {
 	startTime = micros();
@@ -72,27 +71,21 @@ void loop(void) {
 		tft.setCursor(0, 0);
 		tft.println(F("USB"));
 		printMessage(data, DS2.getEcho());
-	} else if(BT.readCommand(btData)) {
-		// Do stuff when BT data spotted	
-		if(DS2.available() == 0) {
-			digitalWrite(UART_SELECT, LOW); // We take pin low of UART_SELECT so we can send data to ECU
-			DS2.writeData(btData);
-			received = true;
-			while(DS2.available() < DS2.getEcho()) { // There need to be some delay between states on the pin
-				if(micros() - startTime > 1000000.0) break;
-			}
-			digitalWrite(UART_SELECT, HIGH);
-		}
+	}
+	
+	// BT requests go through bridge, response is already on its way back to BT when poll returns
+	ReceiveType btResult = bridge.poll();
+	if(btResult == RECEIVE_OK || btResult == RECEIVE_BAD) {
+		DS2Frame frame = bridge.getFrame();
 		tft.setCursor(0, 0);
 		tft.println(F("BT "));
-		printMessage(btData, DS2.getEcho());
-		
+		printMessage((uint8_t *) frame.getData(), frame.getLength());
+		printRps(DS2.getRespondsPerSecond());
 	}
 	
-	// Receive command
-	if((DS2.readData(data)))  {
+	// Receive responses to USB commands while bridge is idle
+	if(!bridge.isBusy() && DS2.readData(data))  {
 		// Do stuff if data received
-		received = true;
 		tft.setCursor(0, 80);
 		tft.print(DS2.getEcho());
 		tft.println(F("   "));
@@ -102,12 +95,6 @@ void loop(void) {
 		printRps(DS2.getRespondsPerSecond());
 	}
 	
-	// Speeds up bluetooth reading
-	if(received) {
-		BT.writeData(data, DS2.getResponseLength());
-		received = false;
-	}
-	
 	printFps();
 }
 
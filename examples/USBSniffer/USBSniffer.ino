@@ -1,5 +1,8 @@
 #define ESP32_CUSTOM
 #include "DS2.h"
+#include "DS2Logger.h"
+#include "DS2Sniffer.h"
+#include "DS2Capture.h"
 // Go to libraries and paste libraries folder from this example folder
 // You can use also Adafruit library although its slower but it supports more screens - code is 100% compatible with it though!
 #include "SPI.h"
@@ -20,8 +23,16 @@ TFT_eSPI tft = TFT_eSPI();
 
 SPIClass SDSPI(HSPI);
 
-// We keep data there, 255 is reccomended for full compatibility, you can use void setMaxDataLength(uint8_t dataLength) if bugs happen
-uint8_t data[255];
+// Sniffer splits K-line traffic into frames on its own task and pairs requests with responses, see DS2Sniffer.h
+uint8_t sniffRing[4096];
+uint8_t recordData[DS2_SNIFF_RECORD];
+DS2SniffRecord record;
+DS2Sniffer sniffer(Serial2, sniffRing, sizeof(sniffRing));
+
+// Binary log written to SD in background, see DS2Logger.h. Requests and responses are stored as capture TX/RX records
+//	with micros of first byte, so file can be replayed on PC with DS2Replay (setLoopback(true)), see DS2Capture.h
+uint8_t logBuffer[16384];
+DS2Logger logger(logBuffer, sizeof(logBuffer));
 
 
 #define TFT_TOUCH_PIN 33
@@ -67,8 +78,8 @@ void setup() {
 	Serial.setTimeout(5);
 		
 	Serial2.begin(9600, SERIAL_8E1);
-	Serial2.setTimeout(5);
 	while(!Serial2);
+	sniffer.begin();
 
 	
 	SDSPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS);
@@ -87,7 +98,6 @@ void setup() {
 
 // Loop variables
 uint32_t startTime;
-uint8_t respLength;
 void loop(void) {
 	startTime = micros();
 	tft.setCursor(0, 13);
@@ -104,10 +114,13 @@ void loop(void) {
 		tft.print((micros() - startTime)/1000.0);
 	}
 
-	if(Serial2.available()) {
-		respLength = Serial2.readBytes(data, 255);
-		printMessage(data, respLength);
-		if(fileReady) logToFile(data, respLength);
+	while(sniffer.read(record, recordData)) {
+		if(record.requestLength) printMessage(record.request, record.requestLength);
+		if(record.responseLength) printMessage(record.response, record.responseLength);
+		if(fileReady) {
+			if(record.requestLength) logger.log(DS2_CAPTURE_TX, record.request, record.requestLength, record.requestAt);
+			if(record.responseLength) logger.log(DS2_CAPTURE_RX, record.response, record.responseLength, record.responseAt);
+		}
 	}
 
 	
@@ -121,7 +134,7 @@ void loop(void) {
 
 
 // Handling SD card event
-String path = "/log01.csv";
+String path = "/log01.bin";
 uint8_t fileNumber = 1;
 uint32_t lastcheck;
 File file;
@@ -134,8 +147,8 @@ bool handleSDCard() {
 	} else {
 		sdReady = true;
 		if(fileReady) {
-//			
 			if(toggleLog) {
+				logger.end();
 				file.close();
 				fileReady = false;
 				toggleLog = false;
@@ -144,16 +157,12 @@ bool handleSDCard() {
 			file = SD.open(path.c_str());
 			while(file) {
 				String fileNumberName = String(++fileNumber);
-				path = path.substring(0, path.indexOf(".csv")-fileNumberName.length());
-				path = path + fileNumberName + ".csv";
+				path = path.substring(0, path.indexOf(".bin")-fileNumberName.length());
+				path = path + fileNumberName + ".bin";
 				file = SD.open(path.c_str());
 			}
 			if(!(file = SD.open(path.c_str(), FILE_WRITE))) return false;
-			file.print("Timestamp,");
-			for(uint8_t i = 0; i < 255; i++) {
-				file.print("B" + String(i) + ",");
-			}
-			file.println();
+			logger.begin(file);
 			lastcheck = millis();
 			fileReady = true;
 			toggleLog = false;
@@ -163,19 +172,6 @@ bool handleSDCard() {
 	return sdReady && fileReady;
 }
 
-void logToFile(uint8_t dat[], uint8_t respLen) {
-	String text = String(millis() - lastcheck);
-	for(uint8_t i = 0; i < respLen; i++) {
-		text += ",";
-		if(dat[i] < 0x10) text += String(0, HEX);
-		text += String(dat[i], HEX);
-	}
-	file.println(text);
-	file.flush();
-}
-
-
-
 // Very slow way of printing message, good for debugging though
 void printMessage(uint8_t array[], uint8_t length) {
 	yDraw = scroll_line();
@@ -0,0 +1,97 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <chrono>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+uint64_t micros64() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+uint32_t micros() {
+	return (uint32_t) micros64();
+}
+
+uint32_t millis() {
+	return (uint32_t) (micros64() / 1000);
+}
+
+void delay(uint32_t ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+	uint64_t start = micros64();
+	while(micros64() - start < us);
+}
+
+void yield() {
+	std::this_thread::yield();
+}
+
+static uint8_t pinLevels[HOST_PINS];
+static uint32_t pinChangeCounts[HOST_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+	if(pin >= HOST_PINS) return;
+	value = value != LOW;
+	if(pinLevels[pin] != value) pinChangeCounts[pin]++;
+	pinLevels[pin] = value;
+}
+
+int digitalRead(uint8_t pin) {
+	return pin < HOST_PINS ? pinLevels[pin] : LOW;
+}
+
+uint32_t pinChanges(uint8_t pin) {
+	return pin < HOST_PINS ? pinChangeCounts[pin] : 0;
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+	size_t written = 0;
+	while(size--) {
+		if(write(*buffer++) == 0) break;
+		written++;
+	}
+	return written;
+}
+
+int Stream::timedRead() {
+	uint32_t startTime = millis();
+	do {
+		int c = read();
+		if(c >= 0) return c;
+		yield();
+	} while(millis() - startTime < timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+	size_t count = 0;
+	while(count < length) {
+		int c = timedRead();
+		if(c < 0) break;
+		buffer[count++] = (char) c;
+	}
+	return count;
+}
@@ -0,0 +1,85 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	Minimal Arduino core for building DS2 on a Linux host.
+*	Only what the library needs is here: Print/Stream, time functions, PROGMEM helpers and pins (kept in memory).
+*	Time is real monotonic time so delays and timeouts behave like they do on a board.
+**/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Lets library code pick host backends (threads, file descriptors)
+#ifndef DS2_HOST
+#define DS2_HOST 1
+#endif
+
+#define PROGMEM
+#define memcpy_P memcpy
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define F(string) (string)
+
+uint32_t millis();
+uint32_t micros();
+uint64_t micros64(); // host only, doesn't wrap
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define HOST_PINS 64
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint32_t pinChanges(uint8_t pin); // host only, number of level changes written
+
+class Print {
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t data) = 0;
+		virtual size_t write(const uint8_t *buffer, size_t size);
+		virtual int availableForWrite() { return 0; }
+		virtual void flush() {}
+};
+
+class Stream : public Print {
+	public:
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual int peek() = 0;
+		
+		void setTimeout(unsigned long timeoutMs) { timeout = timeoutMs; }
+		unsigned long getTimeout() { return timeout; }
+		virtual size_t readBytes(char *buffer, size_t length);
+		size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *) buffer, length); }
+		
+	protected:
+		unsigned long timeout = 1000;
+		int timedRead();
+};
+
+#endif /* Arduino_h */
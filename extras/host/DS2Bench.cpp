@@ -0,0 +1,1274 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2 throughput benchmark against virtual K-line and simulated MS4x ECU.
+*	Build from repository root by compiling every .cpp from src and extras/host together, see README.
+*	Run:
+*		./ds2bench [-d durationMs] [-w loopWorkUs] [-b baud] [-f logFile] [mode...]
+*	Modes: obtain, nonblocking, blocking, scheduled (all by default), decode, memory, baud, async, stats (with -DDS2_STATS=1), lossy, learned, unstaged, pipelined, gap, bus, bridge, sniff, basic, bulk, profile, session, change, pack, telemetry, replay
+**/
+
+#include <DS2.h>
+#include <DS2Scheduler.h>
+#include <DS2Channel.h>
+#include <DS2MemoryMap.h>
+#include <DS2Async.h>
+#include <DS2Bus.h>
+#include <DS2Bridge.h>
+#include <DS2Sniffer.h>
+#include <BasicDS2.h>
+#include <DS2Command.h>
+#include <DS2Profile.h>
+#include <DS2Session.h>
+#include <DS2ChangeTracker.h>
+#include <DS2LogCodec.h>
+#include <DS2Telemetry.h>
+#include <DS2Capture.h>
+#include "VirtualKLine.h"
+#include "StreamPipe.h"
+#include "FdStream.h"
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <atomic>
+
+static DS2Command<5> generalValues = ds2Command<0x12, 0x0B, 0x03>();
+static DS2Command<4> ecuId = ds2Command<0x12, 0x00>();
+
+struct BenchOptions {
+	uint32_t durationMs = 3000;
+	uint32_t loopWorkUs = 0; // simulated TFT/SD work in loop() between calls
+	uint32_t baud = 9600;
+	std::string logFile; // DS2Logger file for pack mode, generated session if empty
+};
+
+struct BenchResult {
+	uint32_t requests = 0, ok = 0, timeouts = 0, bad = 0;
+	uint64_t elapsedUs = 0, cpuNs = 0;
+	float libRps = 0;
+	std::vector<uint32_t> latencies;
+};
+
+static uint64_t cpuNow() {
+	timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void loopWork(uint32_t us) {
+	if(us) delayMicroseconds(us);
+}
+
+// Blocked one-liner, same as examples with obtainValues in loop()
+static void benchObtain(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	uint8_t data[255];
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t sent = micros64();
+		uint64_t cpu = cpuNow();
+		bool ok = ds2.obtainValues(generalValues, data);
+		result.cpuNs += cpuNow() - cpu;
+		result.requests++;
+		if(ok) {
+			result.ok++;
+			result.latencies.push_back(micros64() - sent);
+		} else result.timeouts++;
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+}
+
+// sendCommand at top of loop(), receiveData at the bottom
+static void benchLoop(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	uint8_t data[255];
+	uint64_t sent = 0;
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t cpu = cpuNow();
+		if(ds2.sendCommand(generalValues) != 0) {
+			sent = micros64();
+			result.requests++;
+		}
+		result.cpuNs += cpuNow() - cpu;
+		
+		loopWork(options.loopWorkUs);
+		
+		cpu = cpuNow();
+		ReceiveType type = ds2.receiveData(data);
+		result.cpuNs += cpuNow() - cpu;
+		switch(type) {
+			case RECEIVE_OK:
+				result.ok++;
+				result.latencies.push_back(micros64() - sent);
+				break;
+			case RECEIVE_TIMEOUT:
+				result.timeouts++;
+				break;
+			case RECEIVE_BAD:
+				result.bad++;
+				break;
+			default:
+				break;
+		}
+	}
+	result.elapsedUs = micros64() - start;
+}
+
+// Loop from examples with minGap set, plain and staged - no request may go out sooner than gap after response
+static void benchGap(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	const uint32_t gap = 20000;
+	ds2.setMinGap(gap);
+	uint8_t data[255];
+	for(uint8_t stage = 0; stage < 2; stage++) {
+		uint32_t shortest = 0xFFFFFFFF, sends = 0, responseAt = 0;
+		bool answered = false;
+		// Request went out during last call - from sendCommand, or staged one from sendCommand/receiveData
+		auto check = [&](bool wasSent) {
+			if(wasSent || !ds2.messageStatus()) return;
+			result.requests++;
+			if(!answered) return;
+			uint32_t after = micros() - responseAt;
+			if(after < shortest) shortest = after;
+			sends++;
+		};
+		uint64_t start = micros64();
+		while(micros64() - start < options.durationMs * 500ULL) {
+			bool wasSent = ds2.messageStatus();
+			ds2.sendCommand(generalValues);
+			if(stage) ds2.stageCommand(generalValues);
+			check(wasSent);
+			wasSent = ds2.messageStatus();
+			ReceiveType type = ds2.receiveData(data);
+			if(type == RECEIVE_OK) {
+				result.ok++;
+				answered = true;
+				responseAt = ds2.getFrame().getTimeStamp();
+				wasSent = false;
+			} else if(type == RECEIVE_TIMEOUT) result.timeouts++;
+			else if(type == RECEIVE_BAD) result.bad++;
+			if(type != RECEIVE_WAITING) wasSent = false;
+			check(wasSent);
+		}
+		while(ds2.messageStatus() && ds2.receiveData(data) == RECEIVE_WAITING);
+		ds2.stageCommand(nullptr);
+		ds2.newCommand();
+		printf("  %s: %u requests after response, shortest gap %u us (min %u) %s\n", stage ? "staged" : "plain", sends,
+				shortest, gap, shortest >= gap ? "ok" : "TOO SHORT");
+	}
+	ds2.setMinGap(0);
+	result.elapsedUs = options.durationMs * 1000ULL;
+}
+
+// Loop like in examples - response is printed (loop work) between receiveData and next sendCommand.
+//	Staged request goes out from receiveData right after response, so printing overlaps with bus time
+static void benchPipelined(DS2 &ds2, const BenchOptions &options, BenchResult &result, bool stage) {
+	uint8_t data[255];
+	uint64_t sent = 0;
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t cpu = cpuNow();
+		if(ds2.sendCommand(generalValues) != 0) {
+			sent = micros64();
+			result.requests++;
+		}
+		if(stage) ds2.stageCommand(generalValues);
+		ReceiveType type = ds2.receiveData(data);
+		result.cpuNs += cpuNow() - cpu;
+		if(type == RECEIVE_WAITING) continue;
+		
+		if(type == RECEIVE_OK) {
+			result.ok++;
+			result.latencies.push_back(micros64() - sent);
+		} else if(type == RECEIVE_TIMEOUT) result.timeouts++;
+		else result.bad++;
+		if(ds2.messageStatus()) {
+			sent = micros64();
+			result.requests++;
+		}
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+}
+
+// General values at 20 Hz and ECU id at 2 Hz sharing the bus through scheduler
+static void benchScheduled(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	uint8_t data[255];
+	DS2Scheduler scheduler(ds2);
+	scheduler.add(generalValues, 20, 1);
+	scheduler.add(ecuId, 2, 0);
+	uint64_t sent = micros64();
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint8_t pending = scheduler.getPending();
+		uint64_t cpu = cpuNow();
+		ReceiveType type = scheduler.poll(data);
+		result.cpuNs += cpuNow() - cpu;
+		if(scheduler.getPending() != pending || type != RECEIVE_WAITING) {
+			if(type == RECEIVE_OK) {
+				result.ok++;
+				result.latencies.push_back(micros64() - sent);
+			} else if(type == RECEIVE_TIMEOUT) result.timeouts++;
+			else if(type == RECEIVE_BAD) result.bad++;
+			if(scheduler.getPending() != DS2_SCHEDULER_NONE) {
+				sent = micros64();
+				result.requests++;
+			}
+		}
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+	for(uint8_t i = 0; i < scheduler.getSize(); i++) {
+		printf("  command %u: requested %.2f Hz, achieved %.2f Hz, %u responses\n", i, scheduler.getRequestedRate(i),
+				scheduler.getAchievedRate(i), scheduler.getEntry(i).responses);
+	}
+}
+
+// CPU cost of turning one 0x0B 0x03 response into 40 values - getter calls vs channel table
+static void benchDecode(DS2 &ds2) {
+	uint8_t data[255];
+	if(!ds2.obtainValues(generalValues, data)) {
+		printf("decode: no response\n");
+		return;
+	}
+	DS2Channel channels[40];
+	for(uint8_t i = 0; i < 40; i++) {
+		bool wide = i % 3 == 0;
+		channels[i] = {"ch", (uint8_t) (i % 30), (uint8_t) (wide ? 2 : 1), 0, DS2_SCALE(0.1, 16), DS2_SCALE(-48, 16), 16};
+	}
+	DS2ChannelTable table(channels, 40);
+	DS2Frame frame = ds2.getFrame();
+	const uint32_t iterations = 200000;
+	volatile float sink = 0;
+	float values[40];
+	int32_t fixedValues[40];
+	
+	uint64_t cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		for(uint8_t i = 0; i < 40; i++) {
+			uint16_t raw = channels[i].width == 2 ? ds2.getInt(data, channels[i].offset) : ds2.getByte(data, channels[i].offset);
+			values[i] = 0.1 * raw - 48;
+		}
+		sink = sink + values[n % 40];
+	}
+	uint64_t getterNs = cpuNow() - cpu;
+	
+	cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		table.decode(frame, values);
+		sink = sink + values[n % 40];
+	}
+	uint64_t floatNs = cpuNow() - cpu;
+	
+	cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		table.decode(frame, fixedValues);
+		sink = sink + fixedValues[n % 40];
+	}
+	uint64_t fixedNs = cpuNow() - cpu;
+	
+	printf("decode 40 channels: getters %.1f ns, table float %.1f ns, table fixed %.1f ns per frame\n",
+			(float) getterNs / iterations, (float) floatNs / iterations, (float) fixedNs / iterations);
+}
+
+// Full set of 12 RAM variables read one request per variable vs coalesced requests
+static void benchMemory(DS2 &ds2, SimulatedEcu &ecu, const BenchOptions &options) {
+	static uint8_t ram[0x200];
+	for(uint16_t i = 0; i < sizeof(ram); i++) ram[i] = i * 7;
+	ecu.setMemory(ram, 0xE000, sizeof(ram));
+	
+	const uint16_t addresses[] = {0xE010, 0xE012, 0xE014, 0xE01A, 0xE020, 0xE024, 0xE040, 0xE044, 0xE046, 0xE100, 0xE102, 0xE110};
+	const uint8_t widths[] = {2, 2, 1, 1, 2, 2, 1, 2, 2, 2, 1, 1};
+	DS2MemoryMap map;
+	for(uint8_t i = 0; i < sizeof(widths); i++) map.add(addresses[i], widths[i], DS2_CHANNEL_LITTLE_ENDIAN);
+	
+	const struct { const char *name; uint8_t maxSpan, overhead; } layouts[] = {{"memory-tight", 4, 0}, {"memory-merged", 32, 20}};
+	for(auto &layout : layouts) {
+		uint8_t count = map.build(layout.maxSpan, layout.overhead);
+		uint8_t commands[DS2_MEMORY_REQUESTS][DS2_MEMORY_COMMAND];
+		for(uint8_t i = 0; i < count; i++) map.getCommand(i, commands[i]);
+		
+		uint8_t data[255];
+		int32_t values[DS2_MEMORY_CHANNELS];
+		uint32_t sets = 0, errors = 0;
+		uint64_t start = micros64();
+		while(micros64() - start < options.durationMs * 1000ULL / 2) {
+			bool complete = true;
+			for(uint8_t i = 0; i < count; i++) {
+				if(ds2.obtainValues(commands[i], data)) map.scatter(i, ds2.getFrame(), values);
+				else complete = false;
+			}
+			if(complete) sets++;
+			else errors++;
+		}
+		bool correct = values[0] == (ram[0x11] << 8 | ram[0x10]);
+		printf("%-14s %u requests, %u bytes read, %.2f full sets/s, %u errors, values %s\n", layout.name, count,
+				map.getReadBytes(), sets * 1000000.0 / (micros64() - start), errors, correct ? "ok" : "wrong");
+	}
+}
+
+// Speed-up request made up for simulated ECU, real ones are ECU specific
+static uint8_t speedUp[] = {0x12, 0x05, 0x1B, 0x02, 0x0E};
+static uint8_t speedUpWrong[] = {0x12, 0x05, 0x1B, 0x03, 0x0F};
+
+// Negotiated baud switch, then same loop as nonblocking at new speed; also failing switch falls back
+static void benchBaud(DS2 &ds2, VirtualKLine &line, SimulatedEcu &ecu, const BenchOptions &options, BenchResult &result) {
+	uint8_t data[255];
+	ecu.addBaudSwitch(speedUp, 38400);
+	ecu.addBaudSwitch(speedUpWrong, 19200); // ECU acks but goes to other speed than we ask for
+	ds2.setBaudControl(&line);
+	
+	bool wrong = ds2.switchBaud(speedUpWrong, 38400, ecuId, data);
+	printf("  mismatched switch: %s, tester at %u, ECU at %u\n", wrong ? "switched" : "fell back", line.getBaud(), ecu.getBaud());
+	delay(2100); // ECU goes back to default speed when idle
+	
+	uint64_t start = micros64();
+	bool switched = ds2.switchBaud(speedUp, 38400, ecuId, data);
+	printf("  switch to 38400: %s in %.1f ms, tester at %u, ECU at %u\n", switched ? "ok" : "failed",
+			(micros64() - start) / 1000.0, line.getBaud(), ecu.getBaud());
+	benchLoop(ds2, options, result);
+}
+
+#if DS2_STATS
+static void printStats(const char *name, const DS2CommandStats &stats) {
+	printf("  %-8s %5u req %5u ok %3u tmo %3u bad %3u nak %3u chk  p50 %6.2f p95 %6.2f p99 %6.2f max %6.2f ms\n", name,
+			stats.requests, stats.ok, stats.timeouts, stats.bad, stats.naks, stats.checksumErrors, stats.getPercentile(50) / 1000.0,
+			stats.getPercentile(95) / 1000.0, stats.getPercentile(99) / 1000.0, stats.maxLatency / 1000.0);
+}
+
+// Scheduled mode plus command ECU doesn't know, library's own counters per command
+static void benchStats(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	static uint8_t unknown[] = {0x12, 0x04, 0x99, 0x8F};
+	uint8_t data[255];
+	DS2Scheduler scheduler(ds2);
+	scheduler.add(generalValues, 20, 1);
+	scheduler.add(ecuId, 2, 0);
+	scheduler.add(unknown, 1, 0);
+	ds2.getStats().reset();
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t cpu = cpuNow();
+		ReceiveType type = scheduler.poll(data);
+		result.cpuNs += cpuNow() - cpu;
+		if(type == RECEIVE_OK) result.ok++;
+		else if(type == RECEIVE_TIMEOUT) result.timeouts++;
+		else if(type == RECEIVE_BAD) result.bad++;
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+	
+	DS2Stats stats;
+	ds2.getStats().snapshot(stats);
+	const char *names[] = {"values", "ecu id", "unknown"};
+	uint8_t *commands[] = {generalValues, ecuId, unknown};
+	for(uint8_t i = 0; i < 3; i++) {
+		uint8_t index = stats.find(commands[i], false);
+		if(index != DS2_STATS_NONE) printStats(names[i], stats.getCommand(index));
+	}
+	printStats("total", stats.getTotal());
+	result.requests = stats.getTotal().requests;
+	printf("  resync discarded %u bytes\n", stats.getDiscarded());
+}
+#endif
+
+struct AsyncBenchRequest {
+	BenchResult *result;
+	uint64_t sent;
+};
+
+static void asyncDone(ReceiveType type, const DS2Frame &frame, void *context) {
+	AsyncBenchRequest *request = (AsyncBenchRequest *) context;
+	if(type == RECEIVE_OK) {
+		request->result->ok++;
+		request->result->latencies.push_back(micros64() - request->sent);
+	} else if(type == RECEIVE_TIMEOUT) request->result->timeouts++;
+	else if(type == RECEIVE_BAD) request->result->bad++;
+}
+
+// Same general values as nonblocking but bus runs on its own thread, loop() only keeps two requests queued
+static void benchAsync(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	DS2Async async(ds2);
+	async.begin();
+	AsyncBenchRequest requests[DS2_ASYNC_SLOTS];
+	uint8_t next = 0;
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t cpu = cpuNow();
+		while(async.getQueued() < 2) {
+			requests[next] = {&result, micros64()};
+			if(!async.submit(generalValues, asyncDone, &requests[next])) break;
+			next = (next + 1) % DS2_ASYNC_SLOTS;
+			result.requests++;
+		}
+		result.cpuNs += cpuNow() - cpu;
+		loopWork(options.loopWorkUs ? options.loopWorkUs : 1000);
+	}
+	result.elapsedUs = micros64() - start;
+	async.end();
+	
+	uint8_t id[255];
+	async.begin();
+	DS2Future future = async.request(ecuId, id);
+	printf("  future ecu id: %s\n", future.wait() == RECEIVE_OK ? "ok" : "failed");
+	{
+		// Given up while response is on the way, its stack buffer goes away with it
+		uint8_t scoped[255];
+		DS2Future abandoned = async.request(ecuId, scoped);
+		abandoned.wait(1);
+	}
+	DS2Future after = async.request(ecuId, id);
+	printf("  after abandoned future: %s\n", after.wait() == RECEIVE_OK ? "ok" : "failed");
+	async.end();
+}
+
+static void busResponse(uint8_t module, ReceiveType type, const DS2Frame &frame, void *context) {
+	BenchResult &result = *(BenchResult *) context;
+	if(type == RECEIVE_OK) result.ok++;
+	else if(type == RECEIVE_TIMEOUT) result.timeouts++;
+	else result.bad++;
+}
+
+// DME and EGS on one line, DME gets 3 of every 4 requests; EGS also gets one shot id request
+static void benchBus(DS2 &ds2, VirtualKLine &line, const BenchOptions &options, BenchResult &result) {
+	static uint8_t egsValues[] = {0x32, 0x05, 0x0B, 0x03, 0x3F};
+	static uint8_t egsId[] = {0x32, 0x04, 0x00, 0x36};
+	SimulatedEcu egs(0x32);
+	const uint8_t gearbox[] = {0x03, 0x02, 0x41, 0x00, 0x5A, 0x7C, 0x10, 0x00, 0x21, 0x08};
+	egs.addPayloadResponse(egsValues, gearbox, sizeof(gearbox), 15000);
+	egs.addPayloadResponse(egsId, (const uint8_t *) "7519213", 7, 20000);
+	line.attach(egs);
+	
+	BenchResult dmeResult, egsResult;
+	DS2Bus bus(ds2);
+	uint8_t dme = bus.addModule(0x12, busResponse, &dmeResult, 3);
+	uint8_t gearboxModule = bus.addModule(0x32, busResponse, &egsResult, 1);
+	bus.addCommand(dme, generalValues);
+	bus.addCommand(gearboxModule, egsValues);
+	bus.request(gearboxModule, egsId);
+	
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t cpu = cpuNow();
+		bus.poll();
+		result.cpuNs += cpuNow() - cpu;
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+	BenchResult *modules[] = {&dmeResult, &egsResult};
+	for(uint8_t i = 0; i < bus.getSize(); i++) {
+		const DS2BusModule &module = bus.getEntry(i);
+		printf("  module %02X: %u ok, %u timeouts, %u bad, %.2f rps\n", module.address, modules[i]->ok, modules[i]->timeouts,
+				modules[i]->bad, bus.getAchievedRate(i));
+		result.ok += modules[i]->ok;
+		result.timeouts += modules[i]->timeouts;
+		result.bad += modules[i]->bad;
+	}
+	result.requests = result.ok + result.timeouts + result.bad;
+	printf("  unrouted %u, EGS saw %u requests\n", bus.getUnrouted(), egs.getRequests());
+}
+
+// Laptop tool on other end of Bluetooth pipe keeps two requests outstanding, bridge forwards them to K-line
+static void benchBridge(DS2 &ds2, const BenchOptions &options, BenchResult &result) {
+	const uint8_t selectPin = 25;
+	StreamPipe pipe;
+	DS2 tool(pipe.getEnd(0));
+	DS2Bridge bridge(pipe.getEnd(1), ds2);
+	bridge.setSelectPin(selectPin, LOW);
+	
+	uint8_t toolData[255];
+	std::deque<uint64_t> sent;
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		while(sent.size() < 2) {
+			pipe.getEnd(0).write(generalValues, sizeof(generalValues));
+			sent.push_back(micros64());
+			result.requests++;
+		}
+		uint64_t cpu = cpuNow();
+		bridge.poll();
+		result.cpuNs += cpuNow() - cpu;
+		if(tool.readCommand(toolData)) {
+			if(toolData[2] == 0xA0) result.ok++;
+			else result.bad++;
+			result.latencies.push_back(micros64() - sent.front());
+			sent.pop_front();
+		}
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+	printf("  forwarded %u, timeouts %u, added latency avg %.3f ms (queue %.3f + forward %.3f), max %.3f ms, select toggled %u times\n",
+			bridge.getForwarded(), bridge.getTimeouts(), (bridge.getQueueDelay() + bridge.getForwardDelay()) / 1000.0,
+			bridge.getQueueDelay() / 1000.0, bridge.getForwardDelay() / 1000.0, bridge.getMaxAddedLatency() / 1000.0, pinChanges(selectPin));
+}
+
+// Tester polls through scheduler with lost responses, NAKs and line noise; sniffer on tap pairs what it sees
+static void benchSniff(DS2 &ds2, VirtualKLine &line, SimulatedEcu &ecu, const BenchOptions &options, BenchResult &result) {
+	static uint8_t unknown[] = {0x12, 0x04, 0x99, 0x8F};
+	static uint8_t ring[8192];
+	uint8_t data[255], recordData[DS2_SNIFF_RECORD];
+	KLineTap tap;
+	line.attach(tap);
+	ecu.setDropEvery(9);
+	DS2Sniffer sniffer(tap, ring, sizeof(ring));
+	sniffer.setBaud(options.baud);
+	sniffer.begin(); // own thread like task on ESP32
+	DS2Scheduler scheduler(ds2);
+	scheduler.add(generalValues, 20, 1);
+	scheduler.add(ecuId, 2, 0);
+	scheduler.add(unknown, 1, 0);
+	
+	uint32_t records = 0, paired = 0, unanswered = 0, noise = 0;
+	uint64_t turnaround = 0;
+	uint64_t start = micros64(), lastNoise = start;
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		if(scheduler.poll(data) != RECEIVE_WAITING) {
+			result.requests++;
+			if(micros64() - lastNoise > 500000) {
+				line.write(0x55); // glitch right behind next request, sniffer has to resync on response
+				lastNoise = micros64();
+				noise++;
+			}
+		}
+		uint64_t cpu = cpuNow();
+		DS2SniffRecord record;
+		while(sniffer.read(record, recordData)) {
+			records++;
+			if(record.responseLength != 0 && record.requestLength != 0) {
+				paired++;
+				turnaround += record.responseAt - record.requestAt;
+				if(record.response[2] == 0xA0) result.ok++;
+				else result.bad++;
+			} else if(record.requestLength != 0) {
+				unanswered++;
+				result.timeouts++;
+			}
+		}
+		result.cpuNs += cpuNow() - cpu;
+		loopWork(options.loopWorkUs);
+	}
+	result.elapsedUs = micros64() - start;
+	sniffer.end();
+	printf("  %u frames, %u records: %u paired, %u unanswered, %u dropped; %u noise bytes sent, %u discarded; request to response %.2f ms avg\n",
+			sniffer.getFrames(), records, paired, unanswered, sniffer.getDropped(), noise, sniffer.getDiscarded(),
+			paired ? turnaround / 1000.0 / paired : 0);
+}
+
+// Same loop as nonblocking with protocol fixed at compile time, plus parser cost per frame with and without kwp branches
+static void benchBasic(VirtualKLine &line, const BenchOptions &options, BenchResult &result) {
+	BasicDS2<DS2Protocol, 64> ds2(line);
+	uint64_t sent = 0;
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		uint64_t cpu = cpuNow();
+		if(ds2.sendCommand(generalValues) != 0) {
+			sent = micros64();
+			result.requests++;
+		}
+		result.cpuNs += cpuNow() - cpu;
+		
+		loopWork(options.loopWorkUs);
+		
+		cpu = cpuNow();
+		ReceiveType type = ds2.receiveData();
+		result.cpuNs += cpuNow() - cpu;
+		if(type == RECEIVE_OK) {
+			result.ok++;
+			result.latencies.push_back(micros64() - sent);
+		} else if(type == RECEIVE_TIMEOUT) result.timeouts++;
+		else if(type == RECEIVE_BAD) result.bad++;
+	}
+	result.elapsedUs = micros64() - start;
+	
+	// Echo + 40 byte response through parser
+	uint8_t wire[5 + 40];
+	memcpy(wire, generalValues, 5);
+	wire[5] = 0x12;
+	wire[6] = 40;
+	wire[7] = 0xA0;
+	for(uint8_t i = 8; i < 44; i++) wire[i] = i * 13;
+	wire[44] = 0;
+	for(uint8_t i = 5; i < 44; i++) wire[44] ^= wire[i];
+	uint8_t buffer[64];
+	DS2Parser parser;
+	const uint32_t iterations = 200000;
+	uint32_t complete = 0;
+	uint64_t cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		parser.begin(buffer, 5, 0x12, false, sizeof(buffer), true);
+		for(uint8_t i = 0; i < sizeof(wire); i++) parser.feed(wire[i]);
+		complete += parser.getState() == PARSE_COMPLETE;
+	}
+	uint64_t runtimeNs = cpuNow() - cpu;
+	cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		parser.begin(buffer, 5, 0x12, false, sizeof(buffer), true);
+		for(uint8_t i = 0; i < sizeof(wire); i++) parser.feedAs<DS2Protocol>(wire[i]);
+		complete += parser.getState() == PARSE_COMPLETE;
+	}
+	uint64_t staticNs = cpuNow() - cpu;
+	printf("  parse echo + 40 byte response: feed %.1f ns, feedAs<DS2Protocol> %.1f ns per frame (%u/%u complete)\n",
+			(float) runtimeNs / iterations, (float) staticNs / iterations, complete, 2 * iterations);
+}
+
+// Receive loop as it was before bulk path - available() and read() per byte
+static ParseState pumpPerByte(Stream &serial, DS2Parser &parser) {
+	ParseState state = parser.getState();
+	for(int count = serial.available(); count > 0 && state == PARSE_WAITING; count = serial.available()) {
+		while(count-- > 0 && (state = parser.feed(serial.read())) == PARSE_WAITING);
+	}
+	return state;
+}
+
+// 132 byte memory read response: parser fed byte by byte vs in blocks, then same frame read from pty
+//	by per byte loop vs DS2 bulk path (FdStream readBytes)
+static void benchBulk() {
+	uint8_t wire[5 + 132];
+	memcpy(wire, generalValues, 5);
+	wire[5] = 0x12;
+	wire[6] = 132;
+	wire[7] = 0xA0;
+	for(uint8_t i = 8; i < 136; i++) wire[i] = i * 29;
+	wire[136] = 0;
+	for(uint8_t i = 5; i < 136; i++) wire[136] ^= wire[i];
+	uint8_t buffer[255];
+	DS2Parser parser;
+	
+	const uint32_t iterations = 100000;
+	uint32_t complete = 0;
+	uint64_t cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		parser.begin(buffer, 5, 0x12, false, sizeof(buffer), true);
+		parser.expectEcho(generalValues);
+		for(uint8_t i = 0; i < sizeof(wire); i++) parser.feed(wire[i]);
+		complete += parser.getState() == PARSE_COMPLETE && parser.getEchoOk();
+	}
+	uint64_t byteNs = cpuNow() - cpu;
+	cpu = cpuNow();
+	for(uint32_t n = 0; n < iterations; n++) {
+		parser.begin(buffer, 5, 0x12, false, sizeof(buffer), true);
+		parser.expectEcho(generalValues);
+		for(uint8_t i = 0; i < sizeof(wire);) {
+			uint8_t wanted = parser.getWanted();
+			if(wanted > sizeof(wire) - i) wanted = sizeof(wire) - i;
+			parser.feed(wire + i, wanted);
+			i += wanted;
+		}
+		complete += parser.getState() == PARSE_COMPLETE && parser.getEchoOk();
+	}
+	uint64_t blockNs = cpuNow() - cpu;
+	printf("bulk parse echo + 132 byte response: per byte %.1f ns, block %.1f ns per frame (%u/%u ok)\n",
+			(float) byteNs / iterations, (float) blockNs / iterations, complete, 2 * iterations);
+	
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		printf("bulk: no pty\n");
+		return;
+	}
+	int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	termios raw;
+	tcgetattr(slave, &raw);
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+	FdStream tester(slave);
+	DS2 ds2(tester);
+	
+	// Response only, as seen after readCommand; frame is written whole before timing starts
+	const uint32_t frames = 2000;
+	uint64_t ns[2] = {0, 0};
+	complete = 0;
+	for(uint8_t path = 0; path < 2; path++) {
+		for(uint32_t n = 0; n < frames; n++) {
+			if(write(master, wire + 5, 132) != 132) break;
+			while(tester.available() < 132) yield();
+			cpu = cpuNow();
+			if(path == 0) {
+				parser.begin(buffer, 0, 0, false, sizeof(buffer));
+				complete += pumpPerByte(tester, parser) == PARSE_COMPLETE;
+			} else complete += ds2.readCommand(buffer);
+			ns[path] += cpuNow() - cpu;
+		}
+	}
+	printf("bulk pty 132 byte frame: read() per byte %.1f us, readBytes %.1f us per frame (%u/%u ok)\n",
+			ns[0] / 1000.0 / frames, ns[1] / 1000.0 / frames, complete, 2 * frames);
+	close(slave);
+	close(master);
+}
+
+// Print into memory, stands for file database is written to
+class VectorPrint : public Print {
+	public:
+		std::vector<uint8_t> bytes;
+		size_t write(uint8_t value) override {
+			bytes.push_back(value);
+			return 1;
+		}
+};
+
+// 500 ECU variants with 40 channels each - database lookup vs linear scan of id strings like matchEcu in examples
+static void benchProfile() {
+	const uint16_t count = 500;
+	static char ids[count][12], names[count][16], channelNames[40][8];
+	static DS2Channel channels[count][40];
+	static DS2ProfileDef defs[count];
+	for(uint8_t c = 0; c < 40; c++) snprintf(channelNames[c], sizeof(channelNames[c]), "ch%u", c);
+	for(uint16_t i = 0; i < count; i++) {
+		snprintf(ids[i], sizeof(ids[i]), "%u", 7500000 + (i * 7919) % 100000);
+		snprintf(names[i], sizeof(names[i]), "variant %u", i);
+		for(uint8_t c = 0; c < 40; c++) {
+			channels[i][c] = {channelNames[c], (uint8_t) (c + i % 3), (uint8_t) (c % 3 == 0 ? 2 : 1), 0, DS2_SCALE(0.1, 16), (int32_t) i, 16};
+		}
+		defs[i] = {ids[i], names[i], channels[i], 40};
+	}
+	VectorPrint file;
+	uint32_t size = DS2ProfileDatabase::write(file, defs, count);
+	DS2ProfileMemory source(file.bytes.data(), file.bytes.size());
+	DS2ProfileDatabase database(source);
+	if(size == 0 || !database.begin()) {
+		printf("profile: database not built\n");
+		return;
+	}
+	
+	static DS2Profile profile;
+	const uint32_t rounds = 20;
+	uint32_t found = 0, matching = 0;
+	uint32_t readsBefore = database.getReads();
+	uint64_t cpu = cpuNow();
+	for(uint32_t round = 0; round < rounds; round++) {
+		for(uint16_t n = 0; n < count; n++) {
+			uint16_t i = (n * 211) % count;
+			if(!database.load(ids[i], profile)) continue;
+			found++;
+			matching += profile.getChannel(39).addend == (int32_t) i && profile.getChannel(5).offset == 5 + i % 3;
+		}
+	}
+	uint64_t loadNs = cpuNow() - cpu;
+	uint32_t reads = database.getReads() - readsBefore;
+	
+	volatile uint32_t scanFound = 0;
+	cpu = cpuNow();
+	for(uint32_t round = 0; round < rounds; round++) {
+		for(uint16_t n = 0; n < count; n++) {
+			const char *id = ids[(n * 211) % count];
+			for(uint16_t i = 0; i < count; i++) {
+				if(strcmp(defs[i].ecuId, id) == 0) {
+					scanFound = scanFound + 1;
+					break;
+				}
+			}
+		}
+	}
+	uint64_t scanNs = cpuNow() - cpu;
+	bool missing = !database.load("1234567", profile) && !database.load("07500000", profile); // 7500000 is there
+	
+	printf("profile %u variants, %u byte database: load %.0f ns (%.1f reads, %u/%u ok), linear id scan %.0f ns, unknown id %s\n",
+			count, size, (float) loadNs / (rounds * count), (float) reads / (rounds * count), matching, found,
+			(float) scanNs / (rounds * count), missing ? "not found" : "FOUND");
+}
+
+// Boot to first general values sample: cold handshake with baud switch, then warm start from saved session after
+//	tester reboot (ECU still at 38400), then same session after ECU went back to default speed
+static void benchSession(VirtualKLine &line, SimulatedEcu &ecu) {
+	uint8_t data[255];
+	uint8_t record[DS2_SESSION_SIZE];
+	uint16_t recordLength = 0;
+	ecu.addBaudSwitch(speedUp, 38400);
+	const char *names[] = {"cold", "warm", "stale"};
+	for(uint8_t run = 0; run < 3; run++) {
+		if(run == 2) delay(2100); // ECU idle, back to 9600
+		else delay(200); // reboot
+		line.setBaud(9600);
+		DS2 ds2(line);
+		ds2.setBaudControl(&line);
+		DS2Session session(ds2);
+		
+		uint64_t start = micros64();
+		bool warm = run != 0 && session.unpack(record, recordLength) && session.resume(data);
+		if(!warm) {
+			while(!ds2.obtainValues(ecuId, data));
+			session.capture(ecuId, ds2.getFrame());
+			ds2.switchBaud(speedUp, 38400, ecuId, data);
+		}
+		bool sample = ds2.obtainValues(generalValues, data);
+		uint64_t first = micros64() - start;
+		
+		// Run a bit so learning has samples, then keep snapshot like it would go to NVS
+		for(uint8_t i = 0; i < 10; i++) ds2.obtainValues(i % 5 ? generalValues : ecuId, data);
+		if(run == 0) recordLength = session.pack(record, sizeof(record));
+		printf("  %-5s start: %s, first sample %s after %.1f ms, tester at %u\n", names[run], warm ? "resumed" : "handshake",
+				sample ? "ok" : "FAILED", first / 1000.0, line.getBaud());
+	}
+	printf("session record %u bytes\n", recordLength);
+}
+
+// 20 channels polled at 20 Hz: rpm moves every frame, speed every 5th, coolant flickers 1 bit inside deadband,
+//	the rest change every 300 frames; max silence 1 s. Frames are built up front and whole pass is timed,
+//	so clock reads don't end up in per frame cost
+static void changePass(const char *name, bool engineOn) {
+	DS2Channel channels[20];
+	for(uint8_t i = 0; i < 20; i++) channels[i] = {"ch", (uint8_t) (2 * i), 2, 0, DS2_SCALE(0.1, 16), 0, 16};
+	DS2ChannelTable table(channels, 20);
+	DS2ChangeTracker tracker(table);
+	tracker.setMaxSilence(1000);
+	tracker.setDeadband(2, DS2_SCALE(0.25, 16)); // coolant, 0.1 per bit
+	
+	const uint32_t frames = 100000;
+	std::vector<uint8_t> data(frames * 44);
+	for(uint32_t n = 0; n < frames; n++) {
+		uint8_t *frame = &data[n * 44];
+		frame[0] = 0x12;
+		frame[1] = 44;
+		frame[2] = 0xA0;
+		for(uint8_t i = 0; i < 20; i++) {
+			uint16_t raw = 1000 + i * 10 + n / 300;
+			if(engineOn && i == 0) raw = 800 + (n * 37) % 5000;
+			if(engineOn && i == 1) raw = n / 5;
+			if(engineOn && i == 2) raw = 900 + (n / 7) % 2;
+			frame[3 + 2 * i] = raw >> 8;
+			frame[4 + 2 * i] = raw;
+		}
+	}
+	
+	int32_t values[20];
+	uint64_t cpu = cpuNow();
+	for(uint32_t n = 0; n < frames; n++) tracker.update(DS2Frame(&data[n * 44], false, true, 0), values, n * 50);
+	uint64_t trackNs = cpuNow() - cpu;
+	cpu = cpuNow();
+	for(uint32_t n = 0; n < frames; n++) table.decode(DS2Frame(&data[n * 44], false, true, 0), values);
+	uint64_t decodeNs = cpuNow() - cpu;
+	printf("change %-10s %.2f values reported per frame (of 20), %u/%u frames unchanged, update %.1f ns vs decode all %.1f ns\n",
+			name, (float) tracker.getReported() / frames, tracker.getUnchanged(), frames, (float) trackNs / frames, (float) decodeNs / frames);
+}
+
+static void benchChange() {
+	changePass("engine on", true);
+	changePass("engine off", false);
+}
+
+struct PackRecord {
+	uint8_t command;
+	uint32_t timeStamp;
+	std::vector<uint8_t> payload;
+};
+
+// 30 minutes of MS43 general values at ~20 Hz with driving-like changes and ~1 ms jitter, plus 16 byte
+//	block once a second - stands in for recorded session when no log file is given
+static std::vector<PackRecord> packSession() {
+	uint8_t values[] = {
+		0x03, 0x20, 0x00, 0x1C, 0x5E, 0x4A, 0x7C, 0x80, 0x12, 0x34,
+		0x00, 0x00, 0x0F, 0xA0, 0x64, 0x00, 0x8C, 0x01, 0x2C, 0x7F,
+		0x81, 0x00, 0x8A, 0x00, 0x42, 0x10, 0x00, 0x00, 0x96, 0x00,
+		0x3C, 0x00
+	};
+	uint8_t block[16] = {0x01, 0x00, 0x00, 0x00, 0x55, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00};
+	std::vector<PackRecord> session;
+	uint32_t seed = 12345, at = 1000000;
+	auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+	for(uint32_t n = 0; n < 30 * 60 * 20; n++) {
+		float t = n / 20.0f;
+		uint16_t rpm = 2500 + 1800 * sinf(t / 7) + random() % 40;
+		uint8_t throttle = 40 + 35 * sinf(t / 7 + 0.3f) + random() % 3;
+		values[0] = rpm >> 8;
+		values[1] = rpm;
+		values[3] = 60 + 50 * sinf(t / 40); // speed
+		values[4] = throttle;
+		values[5] = 0x4A + n / 6000; // coolant warming up
+		values[6] = 0x7C + (n / 900) % 4; // intake
+		values[22] = 0x8A + random() % 2; // battery
+		values[24] = 0x42 + random() % 5; // lambda
+		values[25] = random() % 8;
+		values[28] = 0x96 + (throttle > 60); // ignition
+		at += 50000 - 1000 + random() % 2000;
+		session.push_back({0, at, std::vector<uint8_t>(values, values + sizeof(values))});
+		if(n % 20 == 10) {
+			block[8] = n / 1200; // minutes
+			at += 20000 + random() % 2000;
+			session.push_back({1, at, std::vector<uint8_t>(block, block + sizeof(block))});
+		}
+	}
+	return session;
+}
+
+static bool packMatches(const PackRecord &original, const DS2LogRecord &record) {
+	return original.command == record.command && original.timeStamp == record.timeStamp && original.payload.size() == record.length
+			&& memcmp(original.payload.data(), record.payload, record.length) == 0;
+}
+
+static void benchPack(const BenchOptions &options) {
+	std::vector<PackRecord> session;
+	if(!options.logFile.empty()) {
+		FILE *file = fopen(options.logFile.c_str(), "rb");
+		if(file == nullptr) {
+			printf("pack can't open %s\n", options.logFile.c_str());
+			return;
+		}
+		std::vector<uint8_t> log;
+		uint8_t chunk[4096];
+		size_t got;
+		while((got = fread(chunk, 1, sizeof(chunk), file)) > 0) log.insert(log.end(), chunk, chunk + got);
+		fclose(file);
+		uint32_t position = 0;
+		DS2LogRecord record;
+		while(DS2Logger::parse(log.data(), log.size(), position, record)) {
+			session.push_back({record.command, record.timeStamp, std::vector<uint8_t>(record.payload, record.payload + record.length)});
+		}
+	} else session = packSession();
+	if(session.empty()) {
+		printf("pack no records\n");
+		return;
+	}
+	
+	const uint32_t intervals[] = {500000, 2000000, 10000000};
+	for(uint32_t interval : intervals) {
+		DS2LogEncoder encoder;
+		encoder.setKeyframeInterval(interval);
+		std::vector<uint8_t> packed(session.size() * DS2_PACK_RECORD_MAX);
+		uint32_t size = 0;
+		uint64_t cpu = cpuNow();
+		for(const PackRecord &record : session) {
+			size += encoder.encode(record.command, record.payload.data(), record.payload.size(), record.timeStamp, &packed[size]);
+		}
+		uint64_t encodeNs = cpuNow() - cpu;
+		
+		DS2LogDecoder decoder;
+		DS2LogRecord record;
+		uint32_t position = 0, decoded = 0, mismatches = 0;
+		cpu = cpuNow();
+		while(decoder.read(packed.data(), size, position, record)) {
+			if(decoded >= session.size() || !packMatches(session[decoded], record)) mismatches++;
+			decoded++;
+		}
+		uint64_t decodeNs = cpuNow() - cpu;
+		
+		// Streamed in 64 byte reads like from Bluetooth, and started from keyframe in the middle
+		DS2LogDecoder streamed;
+		uint32_t available = 0, streamedCount = 0;
+		position = 0;
+		while(available < size) {
+			available = available + 64 < size ? available + 64 : size;
+			while(streamed.read(packed.data(), available, position, record)) {
+				if(!packMatches(session[streamedCount], record)) mismatches++;
+				streamedCount++;
+			}
+		}
+		DS2LogDecoder seeker;
+		position = size / 2;
+		uint32_t tail = 0, firstAt = 0;
+		if(seeker.seek(packed.data(), size, position)) {
+			while(seeker.read(packed.data(), size, position, record)) if(tail++ == 0) firstAt = record.timeStamp;
+		}
+		if(tail == 0 || session[session.size() - tail].timeStamp != firstAt) mismatches++;
+		
+		float seconds = (session.back().timeStamp - session.front().timeStamp) / 1e6f;
+		printf("pack keyframe %5.1f s: %zu records %.0f s, %u -> %u bytes (%.1fx, %.0f -> %.0f B/s), encode %.0f ns decode %.0f ns per record, %u keyframes, %u mismatches, %u errors\n",
+				interval / 1e6f, session.size(), seconds, encoder.getInputBytes(), size, (float) encoder.getInputBytes() / size,
+				encoder.getInputBytes() / seconds, size / seconds, (float) encodeNs / session.size(), (float) decodeNs / session.size(),
+				encoder.getKeyframes(), mismatches + (decoded != session.size()) + (streamedCount != session.size()), decoder.getErrors());
+	}
+}
+
+// Poll loop pushes 20 channels at 100 Hz into pipe read by other thread at linkRate bytes/s, like Bluetooth with poor
+//	signal. Loop time must stay flat while link falls behind, receiver checks sequence gaps and values against sequence.
+//	With mirror true frames are written straight to link instead, like USB-BT-Example did
+static void telemetryPass(const BenchOptions &options, uint32_t linkRate, bool mirror) {
+	int fds[2];
+	if(pipe(fds) != 0) return;
+	fcntl(fds[1], F_SETPIPE_SZ, 8192); // two pages, about what BT stack buffers
+	fcntl(fds[0], F_SETFL, O_NONBLOCK); // reader must see end of run
+	FdStream link(fds[1]);
+	link.setTimeout(1000);
+	
+	DS2Channel channels[20];
+	for(uint8_t i = 0; i < 20; i++) channels[i] = {"ch", (uint8_t) (2 * i), 2, 0, DS2_SCALE(0.5, 16), 0, 16};
+	channels[0].name = "counter";
+	DS2ChannelTable table(channels, 20);
+	static uint8_t queue[4096];
+	DS2Telemetry telemetry(table, queue, sizeof(queue));
+	telemetry.setWriteChunk(0);
+	telemetry.begin(link, false);
+	
+	std::atomic<bool> running(true);
+	uint32_t received = 0, gaps = 0, schemas = 0, badValues = 0, bytesRead = 0;
+	std::thread reader([&]() {
+		std::vector<uint8_t> data;
+		uint32_t position = 0;
+		int32_t expected = -1;
+		uint64_t start = micros64();
+		while(running) {
+			delay(10);
+			uint32_t allowed = (micros64() - start) * linkRate / 1000000 - bytesRead;
+			uint8_t chunk[4096];
+			ssize_t got = read(fds[0], chunk, allowed < sizeof(chunk) ? allowed : sizeof(chunk));
+			if(got <= 0) continue;
+			bytesRead += got;
+			if(mirror) continue;
+			data.insert(data.end(), chunk, chunk + got);
+			DS2TelemetryMessage message;
+			int32_t values[64];
+			while(DS2Telemetry::parse(data.data(), data.size(), position, message)) {
+				if(message.type == DS2_TELEMETRY_SCHEMA) {
+					schemas++;
+					continue;
+				}
+				received++;
+				if(expected >= 0 && message.sequence != (uint16_t) expected) gaps += (uint16_t) (message.sequence - expected);
+				expected = (uint16_t) (message.sequence + 1);
+				DS2Telemetry::getValues(message, values);
+				if(!(message.mask & 1) || values[0] != (int32_t) (message.sequence * DS2_SCALE(0.5, 16))) badValues++;
+			}
+			data.erase(data.begin(), data.begin() + position);
+			position = 0;
+		}
+	});
+	
+	uint8_t frame[44] = {0x12, 44, 0xA0};
+	uint32_t loops = 0, maxUs = 0;
+	uint64_t totalUs = 0;
+	uint64_t start = micros64();
+	while(micros64() - start < options.durationMs * 1000ULL) {
+		for(uint8_t i = 0; i < 20; i++) {
+			uint16_t raw = i == 0 ? loops : 1000 + i + loops / 50;
+			frame[3 + 2 * i] = raw >> 8;
+			frame[4 + 2 * i] = raw;
+		}
+		uint64_t at = micros64();
+		if(mirror) link.write(frame, sizeof(frame));
+		else {
+			telemetry.push(DS2Frame(frame, false, true, (uint32_t) at));
+			telemetry.service();
+		}
+		uint32_t took = micros64() - at;
+		totalUs += took;
+		if(took > maxUs) maxUs = took;
+		loops++;
+		while(micros64() - at < 10000) delayMicroseconds(200);
+	}
+	running = false;
+	reader.join();
+	close(fds[0]);
+	close(fds[1]);
+	
+	if(mirror) {
+		printf("telemetry %5u B/s raw mirror: %u frames, loop cost avg %.1f us max %.1f ms (blocked on link)\n",
+				linkRate, loops, (float) totalUs / loops, maxUs / 1000.0f);
+	} else {
+		printf("telemetry %5u B/s: %u pushed, %u queued, %u decimated, %u dropped, %u received, %u gaps, %u schemas, %u bad, loop cost avg %.1f us max %u us\n",
+				linkRate, telemetry.getSamples(), telemetry.getQueued(), telemetry.getDecimated(), telemetry.getDropped(),
+				received, gaps, schemas, badValues, (float) totalUs / loops, maxUs);
+	}
+}
+
+static void benchTelemetry(const BenchOptions &options) {
+	telemetryPass(options, 20000, false);
+	telemetryPass(options, 2000, false);
+	telemetryPass(options, 2000, true);
+}
+
+// Session against simulated ECU captured through DS2Capture (or capture file given with -f), then played back into
+//	fresh DS2 at real time, 10x and as fast as possible. Requests are taken from TX records, recorded responses have
+//	to come out same
+static void benchReplay(VirtualKLine &line, const BenchOptions &options) {
+	VectorPrint file;
+	std::vector<std::vector<uint8_t>> responses;
+	uint8_t data[255];
+	if(options.logFile.empty()) {
+		static uint8_t logBuffer[16384];
+		DS2Logger logger(logBuffer, sizeof(logBuffer));
+		logger.begin(file, false);
+		DS2Capture capture(line, logger);
+		DS2 recorder(capture);
+		uint64_t start = micros64();
+		for(uint32_t i = 0; micros64() - start < options.durationMs * 1000ULL; i++) {
+			bool ok = recorder.obtainValues(i % 10 ? generalValues : ecuId, data);
+			DS2Frame frame = recorder.getFrame();
+			responses.push_back(ok ? std::vector<uint8_t>(frame.getData(), frame.getData() + frame.getLength()) : std::vector<uint8_t>());
+			logger.service();
+		}
+		logger.end();
+		printf("replay recorded %zu exchanges in %.2f s, %zu bytes, %u chunks lost\n", responses.size(), (micros64() - start) / 1e6f,
+				file.bytes.size(), capture.getLost());
+	} else {
+		FILE *input = fopen(options.logFile.c_str(), "rb");
+		if(input == nullptr) {
+			printf("replay can't open %s\n", options.logFile.c_str());
+			return;
+		}
+		uint8_t chunk[4096];
+		size_t got;
+		while((got = fread(chunk, 1, sizeof(chunk), input)) > 0) file.bytes.insert(file.bytes.end(), chunk, chunk + got);
+		fclose(input);
+	}
+	
+	// Commands as they were sent; sniffer captures have no echo, then replay makes it
+	std::vector<std::vector<uint8_t>> commands;
+	bool echo = false;
+	uint32_t position = 0;
+	DS2LogRecord record;
+	while(DS2Logger::parse(file.bytes.data(), file.bytes.size(), position, record)) {
+		if(record.command == DS2_CAPTURE_TX) commands.push_back(std::vector<uint8_t>(record.payload, record.payload + record.length));
+		if(record.command == DS2_CAPTURE_ECHO) echo = true;
+	}
+	if(commands.empty()) {
+		printf("replay no TX records\n");
+		return;
+	}
+	
+	const float speeds[] = {1, 10, 0};
+	for(float speed : speeds) {
+		DS2Replay replay(file.bytes.data(), file.bytes.size());
+		replay.setSpeed(speed);
+		replay.setLoopback(!echo);
+		DS2 ds2(replay);
+		uint32_t exchanges = 0, ok = 0, same = 0;
+		uint64_t cpu = cpuNow();
+		uint64_t start = micros64();
+		while(!replay.isFinished() && exchanges < commands.size()) {
+			bool received = ds2.obtainValues(commands[exchanges].data(), data);
+			DS2Frame frame = ds2.getFrame();
+			ok += received;
+			if(exchanges < responses.size() && received == !responses[exchanges].empty() && (!received
+					|| (frame.getLength() == responses[exchanges].size() && memcmp(frame.getData(), responses[exchanges].data(), frame.getLength()) == 0))) same++;
+			exchanges++;
+		}
+		float elapsed = (micros64() - start) / 1e6f;
+		uint64_t cpuNs = cpuNow() - cpu;
+		char name[16];
+		if(speed > 0) snprintf(name, sizeof(name), "%.0fx", speed);
+		else snprintf(name, sizeof(name), "max");
+		printf("replay %-4s %u exchanges, %u ok, %u/%zu same as recorded, %.3f s (%.0f exchanges/s), cpu %.1f us per exchange, %u TX mismatches\n",
+				name, exchanges, ok, same, responses.size(), elapsed, exchanges / elapsed, cpuNs / 1000.0 / exchanges, replay.getMismatches());
+	}
+}
+
+static uint32_t percentile(std::vector<uint32_t> &sorted, uint8_t percent) {
+	if(sorted.empty()) return 0;
+	return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+static void printHeader() {
+	printf("%-12s %6s %6s %5s %5s %7s %7s %8s %8s %8s %8s %9s\n", "mode", "req", "ok", "tmo", "bad",
+			"rps", "librps", "lat-avg", "lat-p50", "lat-p95", "lat-max", "cpu/req");
+	printf("%-12s %6s %6s %5s %5s %7s %7s %8s %8s %8s %8s %9s\n", "", "", "", "", "",
+			"", "", "ms", "ms", "ms", "ms", "us");
+}
+
+static void printResult(const char *mode, BenchResult &result) {
+	std::vector<uint32_t> &lat = result.latencies;
+	std::sort(lat.begin(), lat.end());
+	uint64_t sum = 0;
+	for(uint32_t latency : lat) sum += latency;
+	float rps = result.elapsedUs ? result.ok * 1000000.0 / result.elapsedUs : 0;
+	printf("%-12s %6u %6u %5u %5u %7.2f %7.2f %8.2f %8.2f %8.2f %8.2f %9.1f\n", mode,
+			result.requests, result.ok, result.timeouts, result.bad, rps, result.libRps,
+			lat.empty() ? 0 : sum / 1000.0 / lat.size(), percentile(lat, 50) / 1000.0,
+			percentile(lat, 95) / 1000.0, lat.empty() ? 0 : lat.back() / 1000.0,
+			result.requests ? result.cpuNs / 1000.0 / result.requests : 0);
+}
+
+static void runMode(const std::string &mode, const BenchOptions &options) {
+	VirtualKLine line(options.baud);
+	SimulatedEcu ecu;
+	ecu.setMs4xDefaults();
+	line.attach(ecu);
+	DS2 ds2(line);
+	
+	BenchResult result;
+	if(mode == "obtain") benchObtain(ds2, options, result);
+	else if(mode == "nonblocking") benchLoop(ds2, options, result);
+	else if(mode == "blocking") {
+		ds2.setBlocking(true);
+		benchLoop(ds2, options, result);
+	} else if(mode == "scheduled") benchScheduled(ds2, options, result);
+	else if(mode == "decode") {
+		benchDecode(ds2);
+		return;
+	} else if(mode == "baud") benchBaud(ds2, line, ecu, options, result);
+	else if(mode == "unstaged" || mode == "pipelined") benchPipelined(ds2, options, result, mode == "pipelined");
+	else if(mode == "async") benchAsync(ds2, options, result);
+	else if(mode == "gap") benchGap(ds2, options, result);
+	else if(mode == "bus") benchBus(ds2, line, options, result);
+	else if(mode == "bridge") benchBridge(ds2, options, result);
+	else if(mode == "sniff") benchSniff(ds2, line, ecu, options, result);
+	else if(mode == "basic") benchBasic(line, options, result);
+#if DS2_STATS
+	else if(mode == "stats") benchStats(ds2, options, result);
+#endif
+	else if(mode == "lossy" || mode == "learned") {
+		// Every 10th request lost, full ISO timeout vs learned per command deadline
+		ecu.setDropEvery(10);
+		ds2.setLearning(mode == "learned");
+		benchLoop(ds2, options, result);
+		printf("  request timeout %u ms\n", ds2.getRequestTimeout());
+	}
+	else if(mode == "memory") {
+		benchMemory(ds2, ecu, options);
+		return;
+	} else if(mode == "bulk") {
+		benchBulk();
+		return;
+	} else if(mode == "profile") {
+		benchProfile();
+		return;
+	} else if(mode == "session") {
+		benchSession(line, ecu);
+		return;
+	} else if(mode == "replay") {
+		benchReplay(line, options);
+		return;
+	} else if(mode == "change") {
+		benchChange();
+		return;
+	} else if(mode == "pack") {
+		benchPack(options);
+		return;
+	} else if(mode == "telemetry") {
+		benchTelemetry(options);
+		return;
+	} else {
+		fprintf(stderr, "Unknown mode %s\n", mode.c_str());
+		return;
+	}
+	result.libRps = ds2.getRespondsPerSecond();
+	printResult(mode.c_str(), result);
+}
+
+int main(int argc, char *argv[]) {
+	BenchOptions options;
+	int option;
+	while((option = getopt(argc, argv, "d:w:b:f:")) != -1) {
+		switch(option) {
+			case 'd': options.durationMs = strtoul(optarg, nullptr, 0); break;
+			case 'w': options.loopWorkUs = strtoul(optarg, nullptr, 0); break;
+			case 'b': options.baud = strtoul(optarg, nullptr, 0); break;
+			case 'f': options.logFile = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-d durationMs] [-w loopWorkUs] [-b baud] [-f logFile] [mode...]\n", argv[0]);
+				return 1;
+		}
+	}
+	
+	std::vector<std::string> modes;
+	for(int i = optind; i < argc; i++) modes.push_back(argv[i]);
+	if(modes.empty()) modes = {"obtain", "nonblocking", "blocking", "scheduled"};
+	
+	printf("DS2 bench: %u baud 8E1, %u ms per mode, %u us loop work\n", options.baud, options.durationMs, options.loopWorkUs);
+	printHeader();
+	for(const std::string &mode : modes) runMode(mode, options);
+	return 0;
+}
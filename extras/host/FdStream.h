@@ -0,0 +1,110 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	FdStream
+*	Stream over file descriptor for host builds - USB serial adapter (port set up by caller), pty or pipe.
+*	Descriptor is switched to non-blocking so read() returns -1 when empty like on Arduino. readBytes is one
+*	read() call for whole chunk, so DS2 bulk receive path takes bytes straight from descriptor.
+**/
+
+#ifndef FdStream_h
+#define FdStream_h
+
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+class FdStream : public Stream {
+	public:
+		FdStream(int fd):fd(fd) {
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		}
+		int getFd() { return fd; }
+		
+		int available() override {
+			int count = 0;
+			if(ioctl(fd, FIONREAD, &count) < 0) count = 0;
+			return count + (peeked >= 0);
+		}
+		int read() override {
+			if(peeked >= 0) {
+				int value = peeked;
+				peeked = -1;
+				return value;
+			}
+			uint8_t value;
+			return ::read(fd, &value, 1) == 1 ? value : -1;
+		}
+		int peek() override {
+			if(peeked < 0) peeked = read();
+			return peeked;
+		}
+		size_t readBytes(char *buffer, size_t length) override {
+			size_t count = 0;
+			if(peeked >= 0 && length != 0) {
+				buffer[count++] = (char) peeked;
+				peeked = -1;
+			}
+			uint32_t startTime = millis();
+			while(count < length) {
+				ssize_t result = ::read(fd, buffer + count, length - count);
+				if(result > 0) {
+					count += result;
+					continue;
+				}
+				if(result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) break;
+				uint32_t waited = millis() - startTime;
+				if(waited >= timeout) break;
+				pollfd request = {fd, POLLIN, 0};
+				poll(&request, 1, timeout - waited);
+			}
+			return count;
+		}
+		// Free space of pipe, 0 if descriptor is not pipe (unknown, like Print). Pipe is made of pages and partly read
+		//	page doesn't take new bytes, so one page is kept as slack - write up to this never blocks
+		int availableForWrite() override {
+			int capacity = fcntl(fd, F_GETPIPE_SZ);
+			int queued = 0;
+			if(capacity <= 0 || ioctl(fd, FIONREAD, &queued) < 0) return 0;
+			int room = capacity - queued - (int) sysconf(_SC_PAGESIZE);
+			return room > 0 ? room : 0;
+		}
+		size_t write(uint8_t value) override { return write(&value, 1); }
+		size_t write(const uint8_t *buffer, size_t size) override {
+			size_t count = 0;
+			while(count < size) {
+				ssize_t result = ::write(fd, buffer + count, size - count);
+				if(result > 0) {
+					count += result;
+					continue;
+				}
+				if(result < 0 && errno != EAGAIN && errno != EWOULDBLOCK) break;
+				pollfd request = {fd, POLLOUT, 0};
+				poll(&request, 1, timeout);
+			}
+			return count;
+		}
+		
+	private:
+		int fd;
+		int peeked = -1;
+};
+
+#endif /* FdStream_h */
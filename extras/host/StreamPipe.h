@@ -0,0 +1,92 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	StreamPipe
+*	Two connected in-memory Streams for host builds - what is written to one end can be read from the other.
+*	Stands in for Bluetooth/USB link between laptop tool and ESP32, no timing is modelled.
+**/
+
+#ifndef StreamPipe_h
+#define StreamPipe_h
+
+#include <Arduino.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+class StreamPipe {
+	public:
+		class End : public Stream {
+			public:
+				int available() override {
+					std::lock_guard<std::mutex> guard(pipe->mutex);
+					return in().size();
+				}
+				int read() override {
+					std::lock_guard<std::mutex> guard(pipe->mutex);
+					if(in().empty()) return -1;
+					uint8_t value = in().front();
+					in().pop_front();
+					return value;
+				}
+				int peek() override {
+					std::lock_guard<std::mutex> guard(pipe->mutex);
+					return in().empty() ? -1 : in().front();
+				}
+				size_t readBytes(char *buffer, size_t length) override {
+					size_t count;
+					{
+						std::lock_guard<std::mutex> guard(pipe->mutex);
+						count = length < in().size() ? length : in().size();
+						std::copy(in().begin(), in().begin() + count, buffer);
+						in().erase(in().begin(), in().begin() + count);
+					}
+					if(count < length) count += Stream::readBytes(buffer + count, length - count); // waits for rest
+					return count;
+				}
+				size_t write(uint8_t value) override {
+					std::lock_guard<std::mutex> guard(pipe->mutex);
+					out().push_back(value);
+					return 1;
+				}
+				size_t write(const uint8_t *buffer, size_t size) override {
+					std::lock_guard<std::mutex> guard(pipe->mutex);
+					out().insert(out().end(), buffer, buffer + size);
+					return size;
+				}
+				
+			private:
+				friend class StreamPipe;
+				StreamPipe *pipe = nullptr;
+				uint8_t side = 0;
+				std::deque<uint8_t> &in() { return pipe->buffers[side]; }
+				std::deque<uint8_t> &out() { return pipe->buffers[side ^ 1]; }
+		};
+		
+		StreamPipe() {
+			ends[0].pipe = ends[1].pipe = this;
+			ends[1].side = 1;
+		}
+		End &getEnd(uint8_t side) { return ends[side]; }
+		
+	private:
+		std::mutex mutex;
+		std::deque<uint8_t> buffers[2];
+		End ends[2];
+};
+
+#endif /* StreamPipe_h */
@@ -0,0 +1,240 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VirtualKLine.h"
+
+// Resets ECU frame assembly when bus was idle for longer than this
+#define ECU_FRAME_GAP_US 20000
+
+
+static uint8_t xorBytes(const uint8_t data[], uint8_t length) {
+	uint8_t checksum = 0;
+	for(uint8_t i = 0; i < length; i++) checksum ^= data[i];
+	return checksum;
+}
+
+void SimulatedEcu::addResponse(const uint8_t request[], const uint8_t response[], uint32_t turnaroundUs) {
+	Script script;
+	script.request.assign(request, request + request[1]);
+	script.response.assign(response, response + response[1]);
+	script.turnaround = turnaroundUs;
+	script.generator = nullptr;
+	script.count = 0;
+	script.switchBaud = 0;
+	scripts.push_back(script);
+}
+
+void SimulatedEcu::addPayloadResponse(const uint8_t request[], const uint8_t payload[], uint8_t payloadLength, uint32_t turnaroundUs, Generator generator) {
+	std::vector<uint8_t> response;
+	response.push_back(address);
+	response.push_back(payloadLength + 4);
+	response.push_back(0xA0);
+	response.insert(response.end(), payload, payload + payloadLength);
+	response.push_back(xorBytes(response.data(), response.size()));
+	addResponse(request, response.data(), turnaroundUs);
+	scripts.back().generator = generator;
+}
+
+void SimulatedEcu::setMs4xDefaults() {
+	const uint8_t ecuId[] = {0x12, 0x04, 0x00, 0x16};
+	const uint8_t generalValues[] = {0x12, 0x05, 0x0B, 0x03, 0x1F};
+	
+	// Part number, hardware and software revisions as ASCII
+	const char idPayload[] = "7511570D11000813";
+	addPayloadResponse(ecuId, (const uint8_t *) idPayload, sizeof(idPayload) - 1, 25000);
+	
+	// 0x0B 0x03 block: rpm, speed, throttle, temperatures, battery (offset 22 for 7511570) and so on
+	const uint8_t values[] = {
+		0x03, 0x20, 0x00, 0x1C, 0x5E, 0x4A, 0x7C, 0x80, 0x12, 0x34,
+		0x00, 0x00, 0x0F, 0xA0, 0x64, 0x00, 0x8C, 0x01, 0x2C, 0x7F,
+		0x81, 0x00, 0x8A, 0x00, 0x42, 0x10, 0x00, 0x00, 0x96, 0x00,
+		0x3C, 0x00
+	};
+	addPayloadResponse(generalValues, values, sizeof(values), 12000);
+}
+
+void SimulatedEcu::setMemory(const uint8_t *data, uint32_t base, uint32_t size, uint32_t turnaroundUs, uint8_t command) {
+	memory = data;
+	memoryBase = base;
+	memorySize = size;
+	memoryTurnaround = turnaroundUs;
+	memoryCommand = command;
+}
+
+void SimulatedEcu::addBaudSwitch(const uint8_t request[], uint32_t newBaud, uint32_t turnaroundUs) {
+	addPayloadResponse(request, nullptr, 0, turnaroundUs);
+	scripts.back().switchBaud = newBaud;
+}
+
+bool SimulatedEcu::receive(uint8_t value, uint32_t senderBaud, uint64_t at, std::vector<uint8_t> &response, uint32_t &turnaroundUs, uint32_t &responseBaud) {
+	if(baud != defaultBaud && at - lastByteAt > baudTimeout) baud = defaultBaud;
+	if(!frame.empty() && at - lastByteAt > ECU_FRAME_GAP_US) frame.clear();
+	lastByteAt = at;
+	frame.push_back(VirtualKLine::sample(value, senderBaud, baud));
+	responseBaud = baud;
+	
+	if(frame.size() < 2 || frame.size() < frame[1]) return false;
+	
+	// Complete frame, only answer if it's ours and not corrupted
+	bool valid = frame[1] >= 3 && frame[0] == address && xorBytes(frame.data(), frame.size()) == 0;
+	std::vector<uint8_t> request;
+	request.swap(frame);
+	if(!valid) return false;
+	
+	requests++;
+	if(dropEvery && requests % dropEvery == 0) return false;
+	for(Script &script : scripts) {
+		if(script.request != request) continue;
+		response = script.response;
+		if(script.generator) {
+			script.generator(&response[3], response.size() - 4, script.count);
+			response.back() = xorBytes(response.data(), response.size() - 1);
+		}
+		script.count++;
+		turnaroundUs = script.turnaround;
+		if(script.switchBaud) baud = script.switchBaud; // response still goes out at old speed
+		return true;
+	}
+	
+	if(memory != nullptr && request.size() == 8 && request[2] == memoryCommand) {
+		uint32_t start = (uint32_t) request[3] << 16 | request[4] << 8 | request[5];
+		uint8_t count = request[6];
+		if(start >= memoryBase && start + count <= memoryBase + memorySize && count <= 251) {
+			response.assign({address, 0, 0xA0});
+			response.insert(response.end(), memory + start - memoryBase, memory + start - memoryBase + count);
+			response.push_back(0);
+			response[1] = response.size();
+			response.back() = xorBytes(response.data(), response.size() - 1);
+			turnaroundUs = memoryTurnaround;
+			return true;
+		}
+	}
+	
+	// Unknown command - negative acknowledge
+	naks++;
+	response.assign({address, 0x04, 0xB0, 0x00});
+	response.back() = xorBytes(response.data(), 3);
+	turnaroundUs = nakTurnaround;
+	return true;
+}
+
+
+int VirtualKLine::available() {
+	uint64_t now = micros64();
+	int count = 0;
+	for(const WireByte &wireByte : rx) {
+		if(wireByte.at > now) break;
+		count++;
+	}
+	return count;
+}
+
+int VirtualKLine::read() {
+	if(rx.empty() || rx.front().at > micros64()) return -1;
+	uint8_t value = rx.front().value;
+	rx.pop_front();
+	rxBytes++;
+	return value;
+}
+
+size_t VirtualKLine::readBytes(char *buffer, size_t length) {
+	uint64_t now = micros64();
+	size_t count = 0;
+	while(count < length && !rx.empty() && rx.front().at <= now) {
+		buffer[count++] = (char) rx.front().value;
+		rx.pop_front();
+	}
+	rxBytes += count;
+	if(count < length) count += Stream::readBytes(buffer + count, length - count);
+	return count;
+}
+
+int VirtualKLine::peek() {
+	if(rx.empty() || rx.front().at > micros64()) return -1;
+	return rx.front().value;
+}
+
+uint64_t VirtualKLine::transmit(uint8_t value, uint64_t earliest, uint32_t senderBaud) {
+	uint64_t start = earliest > lineFreeAt ? earliest : lineFreeAt;
+	lineFreeAt = start + byteTime(senderBaud);
+	
+	// Keep RX in arrival order, ECU bytes may already be queued behind this one
+	WireByte wireByte = {lineFreeAt, sample(value, senderBaud, baud)};
+	auto position = rx.end();
+	while(position != rx.begin() && (position - 1)->at > wireByte.at) position--;
+	rx.insert(position, wireByte);
+	for(KLineTap *tap : taps) tap->receive(wireByte.at, wireByte.value);
+	return lineFreeAt;
+}
+
+size_t VirtualKLine::write(uint8_t value) {
+	uint64_t now = micros64();
+	if(now < ecuBusyUntil) collisions++; // tester talks over ECU response
+	uint64_t at = txDoneAt = transmit(value, now, baud);
+	txBytes++;
+	
+	for(SimulatedEcu *ecu : ecus) {
+		std::vector<uint8_t> response;
+		uint32_t turnaround, responseBaud;
+		if(!ecu->receive(value, baud, at, response, turnaround, responseBaud)) continue;
+		uint64_t start = at + turnaround;
+		for(uint8_t responseByte : response) start = transmit(responseByte, start, responseBaud);
+		ecuBusyUntil = start;
+	}
+	return 1;
+}
+
+size_t VirtualKLine::write(const uint8_t *buffer, size_t size) {
+	for(size_t i = 0; i < size; i++) write(buffer[i]);
+	return size;
+}
+
+void VirtualKLine::flush() {
+	while(micros64() < txDoneAt) yield();
+}
+
+
+void KLineTap::receive(uint64_t at, uint8_t value) {
+	std::lock_guard<std::mutex> guard(mutex);
+	auto position = rx.end();
+	while(position != rx.begin() && (position - 1)->first > at) position--;
+	rx.insert(position, std::make_pair(at, value));
+}
+
+int KLineTap::available() {
+	std::lock_guard<std::mutex> guard(mutex);
+	uint64_t now = micros64();
+	int count = 0;
+	for(const auto &wireByte : rx) {
+		if(wireByte.first > now) break;
+		count++;
+	}
+	return count;
+}
+
+int KLineTap::read() {
+	std::lock_guard<std::mutex> guard(mutex);
+	if(rx.empty() || rx.front().first > micros64()) return -1;
+	uint8_t value = rx.front().second;
+	rx.pop_front();
+	return value;
+}
+
+int KLineTap::peek() {
+	std::lock_guard<std::mutex> guard(mutex);
+	if(rx.empty() || rx.front().first > micros64()) return -1;
+	return rx.front().second;
+}
@@ -0,0 +1,152 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	Virtual K-line for host builds
+*	Models a single wire bus with 8E1 byte timing (11 bits per byte), so 9600 baud is ~1.15ms per byte.
+*	Everything written to the line comes back on RX as echo, attached ECUs listen to the wire and answer
+*	after their turnaround time. Timing is computed when bytes are written and RX only releases bytes
+*	once their stop bit would have arrived, so polling code sees the same gaps as on a real bus.
+*	Tester and each ECU have own baud rate, bytes sent at one speed and sampled at other come out garbled.
+**/
+
+#ifndef VirtualKLine_h
+#define VirtualKLine_h
+
+#include <Arduino.h>
+#include <DS2Baud.h>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <mutex>
+
+// Bits per byte for 8E1: start + 8 data + parity + stop
+#define KLINE_BITS_PER_BYTE 11
+
+class SimulatedEcu {
+	public:
+		// Called before response is sent, lets script change payload (counter, rpm sweep etc)
+		typedef std::function<void(uint8_t payload[], uint8_t length, uint32_t count)> Generator;
+		
+		SimulatedEcu(uint8_t address = 0x12):address(address) {}
+		
+		// Request and response are complete frames, checksum included
+		void addResponse(const uint8_t request[], const uint8_t response[], uint32_t turnaroundUs);
+		// Builds positive response {address, length, 0xA0, payload..., checksum} for request
+		void addPayloadResponse(const uint8_t request[], const uint8_t payload[], uint8_t payloadLength, uint32_t turnaroundUs, Generator generator = nullptr);
+		// ECU id and general values as answered by MS43
+		void setMs4xDefaults();
+		// Acks request and changes to baud after response; goes back to default baud after idle timeout
+		void addBaudSwitch(const uint8_t request[], uint32_t baud, uint32_t turnaroundUs = 10000);
+		void setBaudTimeout(uint32_t timeoutUs) { baudTimeout = timeoutUs; }
+		uint32_t getBaud() { return baud; }
+		void setNakTurnaround(uint32_t turnaroundUs) { nakTurnaround = turnaroundUs; }
+		void setDropEvery(uint32_t requestCount) { dropEvery = requestCount; } // every n-th request gets no answer, 0 - never
+		// Answers memory reads {address, length, command, 3 address bytes, count, checksum} from memory
+		void setMemory(const uint8_t *memory, uint32_t base, uint32_t size, uint32_t turnaroundUs = 10000, uint8_t command = 0x06);
+		
+		uint8_t getAddress() { return address; }
+		uint32_t getRequests() { return requests; }
+		uint32_t getNaks() { return naks; }
+		
+		// Called by line for every byte seen on the wire, returns true and fills response (sent at responseBaud) when one should be sent
+		bool receive(uint8_t value, uint32_t senderBaud, uint64_t at, std::vector<uint8_t> &response, uint32_t &turnaroundUs, uint32_t &responseBaud);
+		
+	private:
+		struct Script {
+			std::vector<uint8_t> request;
+			std::vector<uint8_t> response;
+			uint32_t turnaround;
+			Generator generator;
+			uint32_t count;
+			uint32_t switchBaud;
+		};
+		
+		uint8_t address;
+		uint32_t baud = 9600, defaultBaud = 9600, baudTimeout = 2000000;
+		std::vector<Script> scripts;
+		std::vector<uint8_t> frame;
+		uint64_t lastByteAt = 0;
+		uint32_t nakTurnaround = 10000;
+		const uint8_t *memory = nullptr;
+		uint32_t memoryBase = 0, memorySize = 0, memoryTurnaround = 0;
+		uint8_t memoryCommand = 0;
+		uint32_t requests = 0, naks = 0, dropEvery = 0;
+};
+
+
+// Listen only connection to the line, i.e. sniffer hooked to K-line next to tester
+class KLineTap : public Stream {
+	public:
+		~KLineTap() {}
+		int available() override;
+		int read() override;
+		int peek() override;
+		size_t write(uint8_t value) override { return 0; }
+		
+	private:
+		friend class VirtualKLine;
+		std::deque<std::pair<uint64_t, uint8_t> > rx; // arrival time, value
+		std::mutex mutex; // line is written from tester thread, tap read from sniffer thread
+		void receive(uint64_t at, uint8_t value);
+};
+
+
+class VirtualKLine : public Stream, public DS2BaudControl {
+	public:
+		VirtualKLine(uint32_t baud = 9600):baud(baud) {}
+		
+		void attach(SimulatedEcu &ecu) { ecus.push_back(&ecu); }
+		void attach(KLineTap &tap) { taps.push_back(&tap); }
+		// DS2BaudControl - tester side speed
+		bool setBaud(uint32_t newBaud) override { baud = newBaud; return true; }
+		uint32_t getBaud() override { return baud; }
+		uint32_t byteTime() { return byteTime(baud); } // us per byte
+		static uint32_t byteTime(uint32_t baud) { return (KLINE_BITS_PER_BYTE * 1000000UL + baud - 1) / baud; }
+		
+		// Stream
+		int available() override;
+		int read() override;
+		int peek() override;
+		size_t readBytes(char *buffer, size_t length) override; // takes what already arrived in one go
+		size_t write(uint8_t value) override;
+		size_t write(const uint8_t *buffer, size_t size) override;
+		void flush() override; // waits until everything written left the wire, like HardwareSerial
+		
+		uint32_t getTxBytes() { return txBytes; }
+		uint32_t getRxBytes() { return rxBytes; }
+		uint32_t getCollisions() { return collisions; }
+		
+		// What a receiver at one baud makes of byte sent at another
+		static uint8_t sample(uint8_t value, uint32_t senderBaud, uint32_t receiverBaud) { return senderBaud == receiverBaud ? value : value ^ 0x5A; }
+		
+	private:
+		struct WireByte {
+			uint64_t at; // when stop bit is done and byte lands in RX
+			uint8_t value;
+		};
+		
+		uint32_t baud;
+		std::vector<SimulatedEcu *> ecus;
+		std::vector<KLineTap *> taps;
+		std::deque<WireByte> rx;
+		uint64_t lineFreeAt = 0, txDoneAt = 0, ecuBusyUntil = 0;
+		uint32_t txBytes = 0, rxBytes = 0, collisions = 0;
+		
+		uint64_t transmit(uint8_t value, uint64_t earliest, uint32_t senderBaud);
+};
+
+#endif /* VirtualKLine_h */
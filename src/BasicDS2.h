@@ -0,0 +1,153 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	BasicDS2
+*	Request/response core with protocol fixed at compile time - BasicDS2<DS2Protocol, 64> ds2(Serial2);
+*	Header offsets come from DS2Protocol/KWPProtocol descriptors so they fold into constants, parser runs
+*	feedAs<Protocol> with no kwp branches and response lands in buffer of MaxLen bytes inside the object.
+*	Nothing from DS2.cpp is pulled in, so sketches speaking only one protocol save flash and cycles.
+
+*	It covers send, receive (blocking or not), echo check and getters. Learning, staging, statistics and baud switching
+*	stay in DS2 which selects protocol at runtime with setKwp.
+
+*	Echo is XOR checked and compared with command while it arrives but not stored, buffer gets response only. MaxLen still has to fit longest
+	command since its length is checked against it too.
+**/
+
+#ifndef BasicDS2_h
+#define BasicDS2_h
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+  #include "pins_arduino.h"
+  #include "WConstants.h"
+#endif
+
+#include "DS2Protocol.h"
+#include "DS2Parser.h"
+#include "DS2Frame.h"
+
+// Default timeout for message and bulk read chunk, same as DS2
+#ifndef ISO_TIMEOUT
+#define ISO_TIMEOUT 255
+#endif
+
+#ifndef DS2_STAGING
+#define DS2_STAGING 64
+#endif
+
+
+template<class Protocol, uint8_t MaxLen = 255>
+class BasicDS2 {
+	static_assert(MaxLen > Protocol::header(), "MaxLen must fit header and checksum");
+	
+	public:
+		BasicDS2(Stream &stream):serial(stream) {}
+		
+		void setBlocking(bool mode) { blocking = mode; }
+		bool getBlocking() { return blocking; }
+		void setTimeout(uint32_t timeoutMs) { timeout = timeoutMs; }
+		
+		// Same as in DS2 - sendCommand is no-op while response is pending, receiveData returns receive flags
+		uint8_t sendCommand(const uint8_t command[]);
+		ReceiveType receiveData();
+		bool obtainValues(const uint8_t command[]); // blocking one-liner
+		void newCommand() { messageSent = false; parser.reset(); }
+		bool messageStatus() { return messageSent; }
+		ParseState pump(); // moves bytes waiting in RX into parser
+		
+		// Last response, offsets are from start of payload like in DS2::getByte
+		const uint8_t *getData() { return buffer; }
+		uint8_t getDevice() { return device; }
+		DS2Frame getFrame() { return frame; }
+		uint8_t getByte(uint8_t offset) { return buffer[Protocol::header() + offset]; }
+		uint16_t getInt(uint8_t offset) { return (uint16_t) buffer[Protocol::header() + offset] << 8 | buffer[Protocol::header() + offset + 1]; }
+		
+	private:
+		Stream &serial;
+		DS2Parser parser;
+		DS2Frame frame;
+		bool blocking = false;
+		bool messageSent = false;
+		uint8_t device = 0;
+		uint32_t timeout = ISO_TIMEOUT;
+		uint32_t timeStamp = 0;
+		uint8_t buffer[MaxLen];
+};
+
+template<class Protocol, uint8_t MaxLen>
+uint8_t BasicDS2<Protocol, MaxLen>::sendCommand(const uint8_t command[]) {
+	if(messageSent) return 0;
+	while(serial.available() > 0) (void) serial.read();
+	device = Protocol::target(command);
+	uint8_t length = Protocol::frameLength(command);
+	parser.begin(buffer, length, device, Protocol::isKwp(), MaxLen, true);
+	parser.expectEcho(command);
+	messageSent = true;
+	timeStamp = millis();
+	return serial.write(command, length);
+}
+
+template<class Protocol, uint8_t MaxLen>
+ParseState BasicDS2<Protocol, MaxLen>::pump() {
+	uint8_t staging[DS2_STAGING];
+	ParseState state = parser.getState();
+	for(int count = serial.available(); count > 0 && state == PARSE_WAITING; count = serial.available()) {
+		uint8_t wanted = parser.getWanted();
+		if(wanted > count) wanted = count;
+		if(wanted > DS2_STAGING) wanted = DS2_STAGING;
+		uint8_t length = serial.readBytes(staging, wanted);
+		if(length == 0) break;
+		state = parser.feedAs<Protocol>(staging, length);
+	}
+	return state;
+}
+
+template<class Protocol, uint8_t MaxLen>
+ReceiveType BasicDS2<Protocol, MaxLen>::receiveData() {
+	if(!messageSent) return RECEIVE_WAITING;
+	ParseState state;
+	while((state = pump()) == PARSE_WAITING) {
+		if(millis() - timeStamp >= timeout) {
+			newCommand();
+			return RECEIVE_TIMEOUT;
+		}
+		if(!blocking) return RECEIVE_WAITING;
+		if(parser.getRemaining() > 1) delay(1); // sleep while bytes are far, spin only for the last one
+		else yield();
+	}
+	newCommand();
+	if(state != PARSE_COMPLETE) return RECEIVE_BAD;
+	bool ok = Protocol::isOk(buffer, device);
+	frame = DS2Frame(buffer, Protocol::isKwp(), ok, micros());
+	return ok ? RECEIVE_OK : RECEIVE_BAD;
+}
+
+template<class Protocol, uint8_t MaxLen>
+bool BasicDS2<Protocol, MaxLen>::obtainValues(const uint8_t command[]) {
+	newCommand();
+	bool block = blocking;
+	blocking = true;
+	sendCommand(command);
+	ReceiveType result = receiveData();
+	blocking = block;
+	return result == RECEIVE_OK;
+}
+
+#endif /* BasicDS2_h */
@@ -27,21 +27,55 @@ bool DS2::obtainValues(uint8_t command[], uint8_t data[], uint8_t respLen) {
 	bool block = blocking;
 	blocking = true;
 	writeData(command);
+	if(respLen == 0) useLearnedLength();
 	bool result = readData(data);
 	blocking = block;
-	if(!result) clearRX();
-	return (result && checkDataOk(data));
+	if(!result) {
+		clearRX();
+		lengthCache.miss(requestHash);
+	}
+	bool ok = result && checkDataOk(data);
+	// frame is still previous one when read failed, so NAK is told from bytes that came now
+	DS2_STAT(stats.received(ok ? RECEIVE_OK : (result ? RECEIVE_BAD : RECEIVE_TIMEOUT), receivedAck, kwp));
+	return ok;
+}
+
+
+bool DS2::switchBaud(uint8_t request[], uint32_t baud, uint8_t probe[], uint8_t data[]) {
+	if(baudControl == nullptr) return false;
+	uint32_t previousBaud = baudControl->getBaud();
+	if(!obtainValues(request, data)) return false;
+	
+	serial.flush();
+	delay(baudSwitchDelay);
+	if(baudControl->setBaud(baud)) {
+		clearRX();
+		// First probe may hit ECU while it still switches
+		for(uint8_t i = 0; i < 2; i++) {
+			if(obtainValues(probe, data)) return true;
+		}
+	}
+	baudControl->setBaud(previousBaud);
+	clearRX();
+	return false;
 }
 
 
 uint8_t DS2::sendCommand(uint8_t command[], uint8_t respLen) {
 	if(messageSent) {
 		return 0;
+	} else if(stagedCommand != nullptr) {
+		sendStaged(); // staged one goes first
+		return 0;
+	} else if(!waitGap()) {
+		return 0;
 	} else {
 		if(respLen != 0) responseLength = respLen;
 		messageSent = true;
 		clearRX();
-		return writeData(command);
+		uint8_t sent = writeData(command);
+		if(respLen == 0) useLearnedLength();
+		return sent;
 	}
 }
 
@@ -49,18 +83,22 @@ uint8_t DS2::sendCommand(uint8_t command[], uint8_t respLen) {
 
 ReceiveType DS2::receiveData(uint8_t data[]) {
 	uint32_t time;
+	if(!messageSent && stagedCommand != nullptr) sendStaged(); // gap wasn't over when response came
 	if(messageSent) {
 		if(readData(data)) {
 			messageSent = false;
-			if(!checkDataOk(data) || echoLength == responseLength) {
-				return RECEIVE_BAD;
-			}
-			return RECEIVE_OK;
-		} else if((time = (millis() - timeStamp)) < timeout) {
+			ReceiveType result = RECEIVE_OK;
+			if(!checkDataOk(data) || frameEcho == responseLength) result = RECEIVE_BAD;
+			DS2_STAT(stats.received(result, frame.getAck(), kwp));
+			if(stagedCommand != nullptr) sendStaged();
+			return result;
+		} else if((time = (millis() - timeStamp)) < requestTimeout) {
 			return RECEIVE_WAITING;
 		} else {
 			messageSent = false;
+			lengthCache.miss(requestHash);
 //			return time;
+			DS2_STAT(stats.received(RECEIVE_TIMEOUT, 0, kwp));
 			return RECEIVE_TIMEOUT;
 		}
 	} else return RECEIVE_WAITING;
@@ -71,13 +109,44 @@ void DS2::newCommand() {
 	messageSent = false;
 }
 
+bool DS2::isEchoPending() {
+	if(!messageSent || echoLength == 0) return false;
+	ParseState state = parser.getState();
+	return state == PARSE_IDLE || (state == PARSE_WAITING && parser.getEchoPhase());
+}
+
+void DS2::stageCommand(uint8_t command[], uint8_t respLen) {
+	stagedCommand = command;
+	stagedLength = respLen;
+}
+
+// Waits until minGap passed since last response; in non blocking mode returns false instead of waiting
+bool DS2::waitGap() {
+	while(micros() - frame.getTimeStamp() < minGap) {
+		if(!blocking) return false;
+		yield();
+	}
+	return true;
+}
+
+// Sends staged command once gap is over
+bool DS2::sendStaged() {
+	if(!waitGap()) return false;
+	uint8_t *command = stagedCommand;
+	stagedCommand = nullptr;
+	if(stagedLength != 0) responseLength = stagedLength;
+	messageSent = true;
+	parser.reset(); // RX is empty, anything there now belongs to new frame
+	writeData(command);
+	if(stagedLength == 0) useLearnedLength();
+	return true;
+}
+
 
 bool DS2::compareCommands(uint8_t compA[], uint8_t compB[]) {
 	bool same = true;
-	uint8_t length;
-	if(!kwp && compA[1] == compB[1]) length = compA[1];
-	else if(kwp && compA[3] == compB[3]) length = compA[3] + 5;
-	else return false;
+	uint8_t length = ds2CommandLength(compA, kwp);
+	if(length != ds2CommandLength(compB, kwp)) return false;
 	
 	for(uint8_t i = 0; i < length; i++) {
 		if(compA[i] != compB[i]) {
@@ -90,8 +159,7 @@ bool DS2::compareCommands(uint8_t compA[], uint8_t compB[]) {
 
 bool DS2::copyCommand(uint8_t target[], uint8_t source[]) {
 	if(compareCommands(target, source)) return true;
-	uint8_t length = source[1];
-	if(kwp) length = source[3] + 5;
+	uint8_t length = ds2CommandLength(source, kwp);
 	for(uint8_t i = 0; i < length; i++) {
 		target[i] = source[i];
 	}
@@ -101,13 +169,15 @@ bool DS2::copyCommand(uint8_t target[], uint8_t source[]) {
 
 uint8_t DS2::writeData(uint8_t data[], uint8_t length) {
 	timeStamp = millis();
-	if(!kwp) {
-		device = data[0];
-		echoLength = data[1];
-	} else {
-		device = data[1];
-		echoLength = data[3] + 5;
-	}
+	device = kwp ? KWPProtocol::target(data) : DS2Protocol::target(data);
+	echoLength = ds2CommandLength(data, kwp);
+	parser.reset();
+	sentCommand = data;
+	requestHash = ds2CommandHash(data, kwp);
+	requestSentAt = micros();
+	requestTimeout = learning ? lengthCache.getDeadline(requestHash, timeout) : timeout;
+	DS2_STAT(stats.sent(requestHash));
+	DS2_STAT(receivedAck = 0);
 	if(length != 0) {
 		responseLength = length;
 		return writeToSerial(data, length);
@@ -128,88 +198,86 @@ uint8_t DS2::writeToSerial(uint8_t data[], uint8_t length) {
 }
 
 bool DS2::readCommand(uint8_t data[]) {
-	if(!kwp && (blocking || serial.available() > 1)) {
-			uint32_t startTime = millis();
-			uint8_t checksum = serial.read();
-			data[0] = checksum;
-			echoLength = serial.read();
-			data[1] = echoLength;
-			checksum ^= echoLength;
-			while(echoLength-2 > serial.available()) if(millis() - startTime > timeout) break;
-			for(uint8_t i = 2; i < echoLength; i++) {
-				data[i] = serial.read();
-				checksum ^= data[i];
-			}
-			echoLength = 0;
-			if(checksum != 0) return false;
-			device = data[0];
-			return true;
-	}
-	if(kwp && (blocking || serial.available() > 3)) {
-		uint32_t startTime = millis();
-		uint8_t checksum = serial.read();
-		data[0] = checksum;
-		data[1] = serial.read();
-		data[2] = serial.read();
-		data[3] = serial.read();
-		echoLength = data[3] + 5;
-		while(serial.available() < echoLength-4) {
-			if(millis() - startTime > timeout) break;
-			delay(1);
-		}
-		for(uint8_t i = 1; i < echoLength; i++) {
-			if(i > 3) data[i] = serial.read();
-			checksum ^= data[i];
-		}
-		echoLength = 0;
-		if(checksum != 0) return false;
-		device = data[1];
-		return true;
+	if(data != rxBuffer) {
+		rxBuffer = data;
+		parser.reset();
 	}
-	return false;
+	echoLength = 0;
+	requestTimeout = timeout;
+	if(parser.getState() == PARSE_IDLE) parser.begin(data, 0, 0, kwp, maxDataLength);
+	ParseState state = waitFrame();
+	if(state == PARSE_WAITING) return false;
+	parser.reset();
+	if(state != PARSE_COMPLETE) return false;
+	device = kwp ? KWPProtocol::target(data) : DS2Protocol::target(data);
+	frameEcho = 0;
+	frame = DS2Frame(data, kwp, true, micros());
+	return true;
 }
 
 bool DS2::readData(uint8_t data[]) {
-	uint32_t startTime = millis();
-	uint8_t available = serial.available();
-	if(!blocking && echoLength != 0 && available == 0) return false;
-	if(!kwp && device != 0 && available > 0 && serial.peek() != device) {
-		do {
-			serial.read();
-			if(millis() - startTime > timeout) return false;
-		} while(serial.peek() != device);
-		available = serial.available();
+	if(data != rxBuffer) {
+		rxBuffer = data;
+		parser.reset();
 	}
-	if(blocking || available > 2) {
-		while((available = serial.available()) <= 2) {
-			if(millis() - startTime > timeout) break;
-			delay(1);
-		}
-		data[0] = 0xFF;
-		uint32_t extraTimeout = 0;
-		uint8_t echoOffset = kwp ? 4 : 2;
-		if(echoLength + echoOffset > responseLength) responseLength = echoLength + echoOffset;
-		data[echoLength + echoOffset] = 0xFF;
-		if(echoLength > 50) extraTimeout = 200UL;
-		
-		for(uint8_t i = 0; i < responseLength; i++) {
-			while((available = serial.available()) == 0) {
-				if(millis() - startTime > timeout + extraTimeout) break;
-				delay(1);
-			}
-			if(available == 0) break;
-			data[i] = serial.read();
-			// Check Echo
-			if(i == echoOffset - 1) {
-				if(echoLength != 0 && data[i] + (kwp ? 5 : 0) != echoLength) {
-					echoLength = 0;
-				}
-			}
-			if(i == echoLength + echoOffset - 1) responseLength = data[i] + echoLength + (kwp ? 5 : 0);
-		}
-		return checkData(data);
+	ParseState state = waitFrame();
+	if(state == PARSE_WAITING) return false;
+	responseLength = parser.getLength();
+	DS2_STAT(stats.frameError(parser.getDiscarded(), parser.getChecksumError()));
+	DS2_STAT(receivedAck = parser.getAck());
+	parser.reset();
+	if(state != PARSE_COMPLETE) return false;
+	echoLength = parser.getEcho();
+	frameEcho = parser.getStoredEcho();
+	frame = DS2Frame(data + frameEcho, kwp, checkDataOk(data), micros());
+	frameReceived();
+	if(learning && requestHash != 0 && frame.isOk()) lengthCache.learn(requestHash, responseLength, micros() - requestSentAt);
+	return true;
+}
+
+ParseState DS2::pump() {
+	if(parser.getState() == PARSE_IDLE) {
+		if(rxBuffer == nullptr) return PARSE_IDLE;
+		parser.begin(rxBuffer, echoLength, device, kwp, maxDataLength, stripEcho);
+		if(echoLength != 0) parser.expectEcho(sentCommand);
 	}
-	return false;
+	// Bulk read - one readBytes per chunk instead of read() per byte, never past end of frame
+	uint8_t staging[DS2_STAGING];
+	ParseState state = parser.getState();
+	for(int count = serial.available(); count > 0 && state == PARSE_WAITING; count = serial.available()) {
+		uint8_t wanted = parser.getWanted();
+		if(wanted > count) wanted = count;
+		if(wanted > DS2_STAGING) wanted = DS2_STAGING;
+		uint8_t length = serial.readBytes(staging, wanted);
+		if(length == 0) break;
+		state = parser.feed(staging, length);
+	}
+	return state;
+}
+
+// In blocking mode waits until frame is done or timeout, otherwise takes only what is already in RX
+ParseState DS2::waitFrame() {
+	uint32_t startTime = millis();
+	uint32_t extraTimeout = echoLength > 50 ? 200UL : 0;
+	ParseState state;
+	while((state = pump()) == PARSE_WAITING && blocking) {
+		if(millis() - startTime > requestTimeout + extraTimeout) break;
+		if(parser.getRemaining() > 1) delay(1); // sleep while bytes are far, spin only for the last one
+		else yield();
+	}
+	return state;
+}
+
+// Length of response as seen last time for command just written
+void DS2::useLearnedLength() {
+	uint8_t learned = learning ? lengthCache.getLength(requestHash) : 0;
+	if(learned != 0) responseLength = learned;
+}
+
+void DS2::frameReceived() {
+	uint32_t now = millis();
+	commandsPerSecond = 1000.0/(now - timeStamp);
+	timeStamp = now;
 }
 
 void DS2::clearData(uint8_t data[]) {
@@ -221,9 +289,9 @@ void DS2::clearData(uint8_t data[]) {
 
 bool DS2::checkData(uint8_t data[], bool fix) {
 	uint8_t echo = 0;
-	if(echoLength != 0 && !fix) echo += (kwp ? data[3] + 5 : data[1]);
+	if(frameEcho != 0 && !fix) echo += ds2CommandLength(data, kwp);
 	uint8_t checksum = data[echo];
-	uint8_t checkLen = (kwp ? data[echo+3]+echo + 5 : data[echo+1]+echo);
+	uint8_t checkLen = ds2CommandLength(data + echo, kwp) + echo;
 	for(uint8_t i = echo+1; i < checkLen; i++) {
 		checksum ^= data[i];
 	}
@@ -239,11 +307,8 @@ bool DS2::checkData(uint8_t data[], bool fix) {
 }
 
 bool DS2::checkDataOk(uint8_t data[]) {
-	if(kwp) {
-		if(data[echoLength + 2] == device) return true;
-		else return false;
-	}
-	if(!ackByteCheck || data[echoLength+ackByteOffset] == ackByte) return true;
+	if(kwp) return KWPProtocol::isOk(data + frameEcho, device);
+	if(!ackByteCheck || data[frameEcho+ackByteOffset] == ackByte) return true;
 	else return false;
 }
 
@@ -263,9 +328,11 @@ bool DS2::getBlocking() {
 
 void DS2::setTimeout(uint32_t timeoutMs) {
 	timeout = timeoutMs;
+	requestTimeout = timeoutMs;
 }
 
 void DS2::clearRX() {
+	parser.reset();
 	uint32_t startTime = millis();
 	while(serial.available() > 0) {
 		(void) serial.read();
@@ -274,6 +341,7 @@ void DS2::clearRX() {
 }
 
 void DS2::clearRX(uint8_t available, uint8_t length) {
+	parser.reset();
 	uint32_t startTime = millis();
 	while(serial.available() > available) {
 		for(uint8_t i = 0; i < length; i++) {
@@ -308,6 +376,7 @@ uint8_t DS2::getEcho() {
 }
 
 uint8_t DS2::setEcho(uint8_t echo) {
+	frameEcho = echo;
 	return (echoLength = echo);
 }
 
@@ -322,13 +391,13 @@ void DS2::setMaxDataLength(uint8_t dataLength) {
 
 // Getting data
 uint8_t DS2::getByte(uint8_t data[], uint8_t offset) {
-	uint8_t dataPoint = echoLength + offset + (kwp ? 4 : 3);
+	uint8_t dataPoint = frameEcho + offset + header();
 	return data[dataPoint];
 }
 
 uint16_t DS2::getInt(uint8_t data[], uint8_t offset){
 	uint16_t result = 0;
-	uint8_t dataPoint = echoLength + offset + (kwp ? 4 : 3);
+	uint8_t dataPoint = frameEcho + offset + header();
 	((uint8_t *)&result)[1] = data[dataPoint++];
 	((uint8_t *)&result)[0] = data[dataPoint];
 	return result;
@@ -336,7 +405,7 @@ uint16_t DS2::getInt(uint8_t data[], uint8_t offset){
 
 uint64_t DS2::getUint64(uint8_t data[], uint8_t offset, bool reverseEndianess = false, uint8_t length = 8) {
 	uint64_t result = 0;
-	uint8_t dataPoint = echoLength + offset + (kwp ? 4 : 3);
+	uint8_t dataPoint = frameEcho + offset + header();
 	for(uint8_t i = 0; i < length && i < 8; i++) {
 		if(reverseEndianess) ((uint8_t *)&result)[i] = data[dataPoint+i];
 		else ((uint8_t *)&result)[length-1-i] = data[dataPoint+i];
@@ -346,7 +415,7 @@ uint64_t DS2::getUint64(uint8_t data[], uint8_t offset, bool reverseEndianess =
 	
 uint8_t DS2::getString(uint8_t data[], char string[], uint8_t offset, uint8_t length) {
 	uint8_t charPos = 0;
-	uint8_t totalOffset = offset + echoLength + (kwp ? 4 : 3);
+	uint8_t totalOffset = offset + frameEcho + header();
 	for(uint8_t i = totalOffset; i < length + totalOffset; i++) {
 		string[charPos++] = (char) data[i];
 		if(i + 1 == length + totalOffset) string[charPos++] = (char) 0;
@@ -360,7 +429,7 @@ uint8_t DS2::getString(uint8_t data[], char string[], uint8_t offset, uint8_t le
 
 uint8_t DS2::getArray(uint8_t data[], uint8_t array[], uint8_t offset, uint8_t length) {
 	uint8_t charPos = 0;
-	uint8_t totalOffset = offset + echoLength + (kwp ? 4 : 3);
+	uint8_t totalOffset = offset + frameEcho + header();
 	for(uint16_t i = totalOffset; i < length + totalOffset; i++) {
 		array[charPos++] = (char) data[i];
 	}
@@ -31,6 +31,12 @@ v1.0: INITIAL RELEASE
   #include "WConstants.h"
 #endif
 
+#include "DS2Parser.h"
+#include "DS2Frame.h"
+#include "DS2Baud.h"
+#include "DS2Stats.h"
+#include "DS2LengthCache.h"
+
 /**
 *	DS2 Library
 *	Made to simplyfy the communication between arduino code and ECUs using DS2 k-line protocol ISO 9141.
@@ -49,6 +55,7 @@ v1.0: INITIAL RELEASE
 *	4th - Xth bytes are for payload
 
 *	Last byte is always XOR checksum. You can use this calculator to get it: https://www.scadacore.com/tools/programming-calculators/online-checksum-calculator/
+	or let compiler build whole command with ds2Command/kwpCommand, see DS2Command.h
 
 *	Some commands for DS2 for BMW:
 	- 	ECU id - {0x12, 0x04, 0x00, 0x16}
@@ -65,14 +72,10 @@ v1.0: INITIAL RELEASE
 #define MAX_DATA_LENGTH 255
 #endif
 
-
-// Default receive flags
-enum ReceiveType : uint8_t {
-	RECEIVE_WAITING,
-	RECEIVE_TIMEOUT,
-	RECEIVE_OK,
-	RECEIVE_BAD
-};
+// Bytes taken from serial with one readBytes call while receiving, staging buffer lives on stack
+#ifndef DS2_STAGING
+#define DS2_STAGING 64
+#endif
 
 
 class DS2 {
@@ -94,7 +97,11 @@ class DS2 {
 		// Data handling - use those commands to get and check data (data is automatically check when read but you can use command to check it
 		uint8_t writeData(uint8_t data[], uint8_t length = 0); // sets device to first byte value; sets echo to second byte value
 		bool readCommand(uint8_t data[]); // sets echo to 0 so you can use readData and it will read data without echo after calling this command
-		bool readData(uint8_t data[]); // reads command and checks data
+		bool readData(uint8_t data[]); // reads command and checks data; non blocking returns false until whole frame arrived
+		// Moves bytes waiting in RX into parser without waiting, returns parser state; call it often in loop and readData
+		//	only picks up finished frame. Parser and data buffer are not locked, so call it from same task as readData/
+		//	receiveData - not from RX callback (on ESP32 onReceive runs in UART task and would race with loop)
+		ParseState pump();
 		// just use setEcho to 0 if want to check only response or command otherwise it will check whole data (echo + response) for checksum
 		bool checkData(uint8_t data[], bool fix = false); // fix = true allows you to fix checksum of the data you want to send
 		uint8_t available();
@@ -107,6 +114,14 @@ class DS2 {
 																		// if default 0 - same but without respLength (auto learning - might be slower if commands change often)
 		ReceiveType receiveData(uint8_t data[]); // use at end of loop if we want to do other stuff while we wait for command. Can be blocking or non blocking; returns receive flags
 		void newCommand(); // use to force new command - clear RX buffer and allow to send new command
+		// Next command goes out from receiveData as soon as current response is complete, not on next loop(),
+		//	sendCommand is then no-op because message is already sent. Command array must stay valid, data of
+		//	current response must be used before next receiveData call (same buffer gets next response)
+		void stageCommand(uint8_t command[], uint8_t respLen = 0);
+		bool isStaged() { return stagedCommand != nullptr; }
+		// Idle time ECU needs between response and next request; sendCommand returns 0 in non blocking mode until
+		//	it's over (blocking mode waits), and also while staged command is still waiting to go out
+		void setMinGap(uint32_t gapUs) { minGap = gapUs; }
 		bool compareCommands(uint8_t compA[], uint8_t compB[]); // we can use it to easily check if the messages are the same or not
 		bool copyCommand(uint8_t target[], uint8_t source[]); // copies command from source to target, returns true if they were the same;
 		bool checkDataOk(uint8_t data[]); // checks if data ACK byte is == A0;
@@ -120,22 +135,54 @@ class DS2 {
 		uint8_t getArray(uint8_t data[], uint8_t array[], uint8_t offset, uint8_t length = 255); 
 		void clearData(uint8_t data[]); // Fast way to clear data if needed
 		
+		// View of last received response with offsets already resolved, stays valid after next command is sent
+		//	as long as data buffer is not reused; see DS2Frame.h
+		DS2Frame getFrame() { return frame; }
+		
 		// You can get response and echo lengths from commands below
 		uint8_t getResponseLength();
 		uint8_t getEcho();
 		uint8_t setEcho(uint8_t echo);
 		
+		// Echo is checked while it arrives but not stored, data gets only the response and getters don't need echo offset.
+		//	Buffer can be response sized only with setMaxDataLength(responseLength) - clearData and parser still use
+		//	max data length (255 by default) as buffer size. Only response is checked against it, command may be longer
+		void setEchoStrip(bool strip) { stripEcho = strip; }
+		bool getEchoStrip() { return stripEcho; }
+		
 		// KWP protocol handling
 		bool setKwp(bool kwpSet) { return (kwp = kwpSet); };
 		bool getKwp() { return kwp; };
 		bool messageStatus() { return messageSent; };
+		bool isEchoPending(); // own command still on the wire, echo not back yet
+		bool getEchoOk() { return parser.getEchoOk(); } // echo of last command came back same as sent, false on collision
 		
 		// Some ECUs like DDE4 need delay between bytes sent
 		void setSlowSend(uint8_t delay = 0) { slowSend = delay; };
 		uint8_t getSlowSend() { return slowSend; }
 		
+		// Faster K-line after handshake - sends ECU specific request, if ECU acks it transport is switched to baud
+		//	and probe command has to get valid response. On any failure it goes back to previous baud and returns false.
+		//	Needs setBaudControl, see DS2Baud.h
+		void setBaudControl(DS2BaudControl *control) { baudControl = control; }
+		DS2BaudControl *getBaudControl() { return baudControl; }
+		bool switchBaud(uint8_t request[], uint32_t baud, uint8_t probe[], uint8_t data[]);
+		uint32_t getBaud() { return baudControl ? baudControl->getBaud() : 0; }
+		void setBaudSwitchDelay(uint8_t delayMs) { baudSwitchDelay = delayMs; } // time ECU needs to change speed after ack
+		
+		// Response length and turnaround learned per command; sendCommand/obtainValues with respLen == 0 take length
+		//	from it and missing response is given up after learned deadline instead of full timeout
+		void setLearning(bool learn) { learning = learn; }
+		bool getLearning() { return learning; }
+		DS2LengthCache &getLengthCache() { return lengthCache; }
+		uint32_t getRequestTimeout() { return requestTimeout; } // timeout used for command on the bus
+		
 		// Get commands per second calculated from write command followed by readData
 		float getRespondsPerSecond();
+#if DS2_STATS
+		// Latency histogram and error counters per command, see DS2Stats.h
+		DS2Stats &getStats() { return stats; }
+#endif
 		
 		// Clear RX buffer if overload happen
 		void clearRX();
@@ -146,21 +193,49 @@ class DS2 {
 		bool kwp = false;
 		bool blocking = false;
 		bool messageSent = false;
+		bool stripEcho = false;
 		
 		uint8_t slowSend = 0;
+		uint8_t baudSwitchDelay = 10;
+		DS2BaudControl *baudControl = nullptr;
 		uint8_t device = 0;
 		uint8_t echoLength = 0, responseLength, maxDataLength = MAX_DATA_LENGTH;
+		uint8_t frameEcho = 0; // echo in front of last received data, stays valid when next command is already sent
 		
 		uint8_t ackByteOffset = 2;
 		uint8_t ackByte = 0xA0;
 		bool ackByteCheck = true;
 		
 		uint32_t timeout = ISO_TIMEOUT;
+		uint32_t requestTimeout = ISO_TIMEOUT; // timeout or learned deadline of current command
+		
+		bool learning = true;
+		DS2LengthCache lengthCache;
+		uint16_t requestHash = 0; // command waiting for response, 0 if none
+		uint32_t requestSentAt = 0; // micros
 		
 		volatile uint32_t timeStamp;
 		float commandsPerSecond;
 		
+		DS2Parser parser;
+		DS2Frame frame;
+		uint8_t *rxBuffer = nullptr;
+		const uint8_t *sentCommand = nullptr; // echo is compared with it
+		uint8_t *stagedCommand = nullptr;
+		uint8_t stagedLength = 0;
+		uint32_t minGap = 0;
+#if DS2_STATS
+		DS2Stats stats;
+		uint8_t receivedAck = 0; // ack byte of last frame parsed, also when its checksum failed
+#endif
+		
 		uint8_t writeToSerial(uint8_t data[], uint8_t length);
+		ParseState waitFrame();
+		void frameReceived();
+		void useLearnedLength();
+		bool waitGap();
+		bool sendStaged();
+		uint8_t header() { return kwp ? KWPProtocol::header() : DS2Protocol::header(); } // payload offset
 };
 
 #endif /* DS2_h */
\ No newline at end of file
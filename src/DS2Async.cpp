@@ -0,0 +1,285 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DS2Async.h"
+
+
+DS2Async::DS2Async(DS2 &ds2):ds2(ds2) {
+	for(uint8_t i = 0; i < DS2_ASYNC_SLOTS; i++) {
+		slots[i].state = ASYNC_FREE;
+		slots[i].generation = 0;
+		slots[i].released = false;
+	}
+}
+
+DS2Future &DS2Future::operator=(DS2Future &&other) {
+	if(this != &other) {
+		release();
+		async = other.async;
+		slot = other.slot;
+		generation = other.generation;
+		other.async = nullptr;
+	}
+	return *this;
+}
+
+bool DS2Future::isReady() {
+	return getResult() != RECEIVE_WAITING;
+}
+
+ReceiveType DS2Future::getResult() {
+	if(async == nullptr) return RECEIVE_TIMEOUT;
+	DS2Async::Slot &entry = async->slots[slot];
+	async->lock();
+	ReceiveType result = entry.generation == generation && entry.state == ASYNC_DONE ? entry.result : RECEIVE_WAITING;
+	async->unlock();
+	return result;
+}
+
+ReceiveType DS2Future::wait(uint32_t timeoutMs) {
+	uint32_t startTime = millis();
+	ReceiveType result;
+	while((result = getResult()) == RECEIVE_WAITING) {
+		if(millis() - startTime > timeoutMs) break;
+		if(async->isRunning()) delay(1);
+		else async->service(); // nobody else drives the bus
+	}
+	return result;
+}
+
+DS2Frame DS2Future::getFrame() {
+	if(!isReady()) return DS2Frame();
+	return async->slots[slot].frame;
+}
+
+void DS2Future::release() {
+	if(async == nullptr) return;
+	DS2Async::Slot &entry = async->slots[slot];
+	uint8_t *data = nullptr;
+	async->lock();
+	if(entry.generation == generation) {
+		if(entry.state == ASYNC_SENT) {
+			// Freed when response arrives, until then it goes to shared buffer - caller's one may be gone
+			data = entry.data;
+			entry.data = async->buffer;
+			entry.released = true;
+		} else async->freeSlot(slot);
+	}
+	async->unlock();
+	// Task may be inside receiveData with old buffer, wait until it's out
+	while(data != nullptr && async->receiving == data) delay(1);
+	async = nullptr;
+}
+
+
+
+#if defined(ESP32)
+void DS2Async::asyncTask(void *arg) {
+	DS2Async *async = (DS2Async *) arg;
+	async->ds2.setBlocking(true); // task has nothing else to do while it waits
+	while(async->running) {
+		if(!async->service()) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+	}
+	async->taskDone = true;
+	vTaskDelete(nullptr);
+}
+#endif
+
+bool DS2Async::begin(uint8_t core, uint8_t priority) {
+	if(running) return true;
+	running = true;
+#if defined(ESP32)
+	taskDone = false;
+	if(xTaskCreatePinnedToCore(asyncTask, "DS2Async", 4096, this, priority, &task, core) != pdPASS) {
+		running = false;
+		taskDone = true;
+		return false;
+	}
+	return true;
+#elif defined(DS2_HOST)
+	(void) core; // one thread, no pinning or priority on host
+	(void) priority;
+	ds2.setBlocking(true);
+	thread = std::thread([this]() {
+		while(running) {
+			if(service()) continue;
+			std::unique_lock<std::mutex> guard(mutex);
+			wake.wait_for(guard, std::chrono::milliseconds(10), [this]() { return pending || !running; });
+			pending = false;
+		}
+	});
+	return true;
+#else
+	(void) core;
+	(void) priority;
+	running = false; // no task here, call service() in loop
+	return false;
+#endif
+}
+
+void DS2Async::end() {
+	if(!running) return;
+	running = false;
+#if defined(ESP32)
+	xTaskNotifyGive(task);
+	while(!taskDone) delay(1);
+	task = nullptr;
+#elif defined(DS2_HOST)
+	notify();
+	if(thread.joinable()) thread.join();
+#endif
+}
+
+void DS2Async::lock() {
+#if defined(ESP32)
+	portENTER_CRITICAL(&mux);
+#elif defined(DS2_HOST)
+	mutex.lock();
+#endif
+}
+
+void DS2Async::unlock() {
+#if defined(ESP32)
+	portEXIT_CRITICAL(&mux);
+#elif defined(DS2_HOST)
+	mutex.unlock();
+#endif
+}
+
+void DS2Async::notify() {
+#if defined(ESP32)
+	if(task != nullptr) xTaskNotifyGive(task);
+#elif defined(DS2_HOST)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		pending = true;
+	}
+	wake.notify_one();
+#endif
+}
+
+
+bool DS2Async::submit(uint8_t command[], DS2AsyncCallback callback, void *context, uint8_t data[]) {
+	return enqueue(command, data, callback, context) != DS2_ASYNC_NONE;
+}
+
+DS2Future DS2Async::request(uint8_t command[], uint8_t data[]) {
+	uint8_t slot = enqueue(command, data, nullptr, nullptr);
+	if(slot == DS2_ASYNC_NONE) return DS2Future();
+	return DS2Future(this, slot, slots[slot].generation); // generation only changes once future frees it
+}
+
+// Copies command into free slot, no callback means it's owned by future
+uint8_t DS2Async::enqueue(uint8_t command[], uint8_t data[], DS2AsyncCallback callback, void *context) {
+	uint8_t length = ds2CommandLength(command, ds2.getKwp());
+	if(length > DS2_ASYNC_COMMAND) return DS2_ASYNC_NONE;
+	uint8_t slot = DS2_ASYNC_NONE;
+	lock();
+	for(uint8_t i = 0; i < DS2_ASYNC_SLOTS; i++) {
+		if(slots[i].state == ASYNC_FREE) {
+			slot = i;
+			break;
+		}
+	}
+	if(slot != DS2_ASYNC_NONE) {
+		Slot &entry = slots[slot];
+		memcpy(entry.command, command, length);
+		entry.data = data != nullptr ? data : buffer;
+		entry.callback = callback;
+		entry.context = context;
+		entry.released = false;
+		entry.order = nextOrder++;
+		entry.state = ASYNC_QUEUED;
+	} else dropped++;
+	unlock();
+	if(slot != DS2_ASYNC_NONE) notify();
+	return slot;
+}
+
+void DS2Async::freeSlot(uint8_t slot) {
+	slots[slot].state = ASYNC_FREE;
+	slots[slot].generation++; // outdated futures see it's not theirs anymore
+}
+
+// Oldest queued request goes on the bus
+void DS2Async::startNext() {
+	uint8_t next = DS2_ASYNC_NONE;
+	lock();
+	for(uint8_t i = 0; i < DS2_ASYNC_SLOTS; i++) {
+		if(slots[i].state != ASYNC_QUEUED) continue;
+		if(next == DS2_ASYNC_NONE || (int32_t) (slots[i].order - slots[next].order) < 0) next = i;
+	}
+	if(next != DS2_ASYNC_NONE) slots[next].state = ASYNC_SENT;
+	unlock();
+	if(next == DS2_ASYNC_NONE) return;
+	ds2.newCommand();
+	if(ds2.sendCommand(slots[next].command) == 0) {
+		// Gap after last response not over yet, try again on next service()
+		lock();
+		slots[next].state = ASYNC_QUEUED;
+		unlock();
+		return;
+	}
+	current = next;
+}
+
+bool DS2Async::service() {
+	if(current == DS2_ASYNC_NONE) {
+		startNext();
+		return current != DS2_ASYNC_NONE;
+	}
+	
+	uint8_t done = current;
+	Slot &entry = slots[done];
+	lock();
+	receiving = entry.data;
+	unlock();
+	ReceiveType result = ds2.receiveData(receiving);
+	receiving = nullptr;
+	if(result == RECEIVE_WAITING) return true;
+	
+	lock();
+	entry.frame = result == RECEIVE_TIMEOUT ? DS2Frame() : ds2.getFrame();
+	entry.result = result;
+	entry.state = ASYNC_DONE;
+	unlock();
+	
+	// Bus is busy with next request while callback runs, only writes happen until next service()
+	current = DS2_ASYNC_NONE;
+	startNext();
+	
+	if(entry.callback != nullptr) {
+		entry.callback(result, entry.frame, entry.context);
+		lock();
+		freeSlot(done);
+		unlock();
+	} else {
+		lock();
+		if(entry.released) freeSlot(done);
+		unlock();
+	}
+	return true;
+}
+
+uint8_t DS2Async::getQueued() {
+	uint8_t count = 0;
+	lock();
+	for(uint8_t i = 0; i < DS2_ASYNC_SLOTS; i++) {
+		if(slots[i].state == ASYNC_QUEUED || slots[i].state == ASYNC_SENT) count++;
+	}
+	unlock();
+	return count;
+}
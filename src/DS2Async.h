@@ -0,0 +1,169 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Async
+*	Queue requests from anywhere and get results by callback or future, while DS2 is serviced on its own -
+*	FreeRTOS task on ESP32, std::thread on host build, or service() in loop everywhere else.
+*	Bus throughput doesn't depend on how long your loop (TFT redraw, SD) takes anymore.
+
+*	Queue has DS2_ASYNC_SLOTS slots, command is copied in so caller's array can change right after submit.
+*	Next request goes out before callback of previous one runs, so callbacks don't add to bus idle time.
+*	Callbacks run on the DS2 task - keep them short and don't call DS2 from them.
+
+*	Usage:
+	DS2Async async(DS2);
+	async.begin(); // starts task
+	
+	void onValues(ReceiveType result, const DS2Frame &frame, void *context) { ... }
+	async.submit(generalValues, onValues);
+	
+	DS2Future id = async.request(ecuId, idData);
+	if(id.wait() == RECEIVE_OK) ...
+**/
+
+#ifndef DS2Async_h
+#define DS2Async_h
+
+#include "DS2.h"
+
+#if defined(DS2_HOST)
+	#include <mutex>
+	#include <condition_variable>
+	#include <thread>
+#endif
+
+// Max queued and in flight requests
+#ifndef DS2_ASYNC_SLOTS
+#define DS2_ASYNC_SLOTS 8
+#endif
+
+// Longest command that can be queued
+#ifndef DS2_ASYNC_COMMAND
+#define DS2_ASYNC_COMMAND 16
+#endif
+
+#define DS2_ASYNC_NONE 0xFF
+
+typedef void (*DS2AsyncCallback)(ReceiveType result, const DS2Frame &frame, void *context);
+
+enum AsyncState : uint8_t {
+	ASYNC_FREE,
+	ASYNC_QUEUED,
+	ASYNC_SENT,
+	ASYNC_DONE
+};
+
+class DS2Async;
+
+
+// Result of request(), slot is given back when future is released or destroyed
+class DS2Future {
+	public:
+		DS2Future() {}
+		DS2Future(DS2Future &&other):async(other.async), slot(other.slot), generation(other.generation) { other.async = nullptr; }
+		DS2Future &operator=(DS2Future &&other);
+		DS2Future(const DS2Future &) = delete;
+		DS2Future &operator=(const DS2Future &) = delete;
+		~DS2Future() { release(); }
+		
+		bool isValid() { return async != nullptr; } // false if queue was full
+		bool isReady();
+		ReceiveType getResult(); // RECEIVE_WAITING until ready
+		ReceiveType wait(uint32_t timeoutMs = 1000);
+		DS2Frame getFrame(); // response, data is in buffer passed to request()
+		// Gives slot back; if request is on the bus, waits until background task stops writing into its data
+		void release();
+		
+	private:
+		friend class DS2Async;
+		DS2Async *async = nullptr;
+		uint8_t slot = DS2_ASYNC_NONE;
+		uint16_t generation = 0;
+		
+		DS2Future(DS2Async *async, uint8_t slot, uint16_t generation):async(async), slot(slot), generation(generation) {}
+};
+
+
+class DS2Async {
+	public:
+		// Takes over ds2, don't use it directly while requests are queued
+		DS2Async(DS2 &ds2);
+		~DS2Async() { end(); }
+		
+		// Starts background task (ESP32: pinned to core with priority; host: thread). Without it call service() in loop
+		bool begin(uint8_t core = 0, uint8_t priority = 2);
+		void end();
+		
+		// Queues command; callback gets result and frame. data is response buffer, nullptr uses shared one which
+		//	is only valid inside callback. Returns false if queue is full or command too long
+		bool submit(uint8_t command[], DS2AsyncCallback callback, void *context = nullptr, uint8_t data[] = nullptr);
+		// Queues command and gives future; data must stay valid until future is released
+		DS2Future request(uint8_t command[], uint8_t data[]);
+		
+		// Runs one step - sends next queued command and checks response of current one. Returns true if there is work left
+		bool service();
+		
+		uint8_t getQueued(); // requests waiting or in flight
+		uint32_t getDropped() { return dropped; } // submits rejected because queue was full
+		bool isRunning() { return running; }
+		
+	private:
+		friend class DS2Future;
+		
+		struct Slot {
+			uint8_t command[DS2_ASYNC_COMMAND];
+			uint8_t *data;
+			DS2AsyncCallback callback;
+			void *context;
+			DS2Frame frame;
+			uint32_t order;
+			uint16_t generation;
+			volatile AsyncState state;
+			volatile ReceiveType result;
+			bool released; // future gone while request was on the bus
+		};
+		
+		DS2 &ds2;
+		Slot slots[DS2_ASYNC_SLOTS];
+		uint8_t buffer[MAX_DATA_LENGTH];
+		uint8_t *volatile receiving = nullptr; // buffer receiveData is writing to right now
+		uint8_t current = DS2_ASYNC_NONE;
+		uint32_t nextOrder = 0;
+		volatile uint32_t dropped = 0;
+		volatile bool running = false;
+		
+#if defined(ESP32)
+		portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+		TaskHandle_t task = nullptr;
+		volatile bool taskDone = true;
+		static void asyncTask(void *async);
+#elif defined(DS2_HOST)
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::thread thread;
+		bool pending = false;
+#endif
+		
+		void lock();
+		void unlock();
+		void notify();
+		uint8_t enqueue(uint8_t command[], uint8_t data[], DS2AsyncCallback callback, void *context);
+		void startNext();
+		void freeSlot(uint8_t slot);
+};
+
+#endif /* DS2Async_h */
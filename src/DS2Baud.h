@@ -0,0 +1,68 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2BaudControl
+*	Stream can't change its baud rate, so DS2 gets this to reconfigure transport after ECU agreed to faster speed.
+*	DS2SerialBaud works with any HardwareSerial like class that has end() and begin(baud, config).
+*	On ESP32 you may prefer own subclass calling Serial2.updateBaudRate(baud) which doesn't reinstall the driver.
+
+*	Usage:
+	DS2SerialBaud<HardwareSerial> baudControl(Serial2, 9600, SERIAL_8E1);
+	DS2.setBaudControl(&baudControl);
+	DS2.switchBaud(speedUpCommand, 125000, ecuId, data);
+**/
+
+#ifndef DS2Baud_h
+#define DS2Baud_h
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+  #include "pins_arduino.h"
+  #include "WConstants.h"
+#endif
+
+
+class DS2BaudControl {
+	public:
+		virtual ~DS2BaudControl() {}
+		virtual bool setBaud(uint32_t baud) = 0; // returns false if transport can't do this speed
+		virtual uint32_t getBaud() = 0;
+};
+
+
+template <class SerialType> class DS2SerialBaud : public DS2BaudControl {
+	public:
+		DS2SerialBaud(SerialType &serial, uint32_t baud, uint32_t config):serial(serial), baud(baud), config(config) {}
+		
+		bool setBaud(uint32_t newBaud) override {
+			serial.flush();
+			serial.end();
+			serial.begin(newBaud, config);
+			baud = newBaud;
+			return true;
+		}
+		uint32_t getBaud() override { return baud; }
+		
+	private:
+		SerialType &serial;
+		uint32_t baud;
+		uint32_t config;
+};
+
+#endif /* DS2Baud_h */
@@ -0,0 +1,98 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Bridge.h>
+
+// Weight of newest sample in averaged delays is 1/2^DELAY_SHIFT
+#define DELAY_SHIFT 3
+
+
+static void average(uint32_t &value, uint32_t sample) {
+	if(value == 0) value = sample;
+	else value = value - (value >> DELAY_SHIFT) + (sample >> DELAY_SHIFT);
+}
+
+void DS2Bridge::setSelectPin(uint8_t pin, uint8_t activeLevel) {
+	selectPin = pin;
+	selectActive = activeLevel;
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, !activeLevel);
+	selected = false;
+}
+
+void DS2Bridge::select(bool active) {
+	if(selectPin == DS2_BRIDGE_NO_PIN || selected == active) return;
+	digitalWrite(selectPin, active ? selectActive : !selectActive);
+	selected = active;
+}
+
+// Parses client bytes straight into free queue slot; when queue is full bytes wait in client's RX
+void DS2Bridge::readClient() {
+	if(queued >= DS2_BRIDGE_QUEUE) return;
+	client.setKwp(bus.getKwp());
+	Request &request = queue[(head + queued) % DS2_BRIDGE_QUEUE];
+	if(client.readCommand(request.data)) {
+		request.receivedAt = micros();
+		queued++;
+	}
+}
+
+void DS2Bridge::startNext() {
+	if(sending || queued == 0) return;
+	Request &request = queue[head];
+	select(true);
+	bus.newCommand();
+	if(bus.sendCommand(request.data) == 0) {
+		select(false); // gap after last response not over yet, next poll tries again
+		return;
+	}
+	sentDelay = micros() - request.receivedAt;
+	average(queueDelay, sentDelay);
+	sending = true;
+}
+
+ReceiveType DS2Bridge::poll() {
+	readClient();
+	ReceiveType result = RECEIVE_WAITING;
+	if(sending) {
+		if(selected && !bus.isEchoPending()) select(false); // line is ECU's now
+		result = bus.receiveData(busData);
+		if(result != RECEIVE_WAITING) {
+			sending = false;
+			select(false);
+			head = (head + 1) % DS2_BRIDGE_QUEUE;
+			queued--;
+			if(result == RECEIVE_TIMEOUT) timeouts++;
+			else {
+				// Negative responses go to client too, it's the ECU's answer
+				lastFrame = bus.getFrame();
+				clientStream.write(lastFrame.getData(), lastFrame.getLength());
+				uint32_t delay = micros() - lastFrame.getTimeStamp();
+				average(forwardDelay, delay);
+				if(sentDelay + delay > maxAdded) maxAdded = sentDelay + delay;
+				forwarded++;
+			}
+		}
+	}
+	startNext();
+	return result;
+}
+
+void DS2Bridge::resetStats() {
+	forwarded = timeouts = 0;
+	queueDelay = forwardDelay = maxAdded = 0;
+}
@@ -0,0 +1,104 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Bridge
+*	Forwards DS2/KWP between client Stream (Bluetooth, USB - INPA style tools on laptop) and K-line.
+*	Only complete frames with valid checksum are passed: client requests are parsed as they come and queued
+*	while bus is busy, response goes back to client without echo, as soon as its checksum is checked.
+*	Optional select pin (UART_SELECT on ESP32 boards) is driven active only while own request is on the wire.
+
+*	Added latency is measured on both sides - from client request complete to bus write (queue delay) and from
+	bus response complete to client write done (forward delay).
+
+*	Usage:
+	DS2 kline(Serial2);
+	DS2Bridge bridge(SerialBT, kline);
+	bridge.setSelectPin(UART_SELECT, LOW);
+	void loop() {
+		bridge.poll();
+	}
+**/
+
+#ifndef DS2Bridge_h
+#define DS2Bridge_h
+
+#include "DS2.h"
+
+// Client requests waiting for bus
+#ifndef DS2_BRIDGE_QUEUE
+#define DS2_BRIDGE_QUEUE 4
+#endif
+
+// Longest client request
+#ifndef DS2_BRIDGE_COMMAND
+#define DS2_BRIDGE_COMMAND 64
+#endif
+
+#define DS2_BRIDGE_NO_PIN 0xFF
+
+
+class DS2Bridge {
+	public:
+		// bus has to be non blocking, bridge keeps polling it
+		DS2Bridge(Stream &client, DS2 &bus):clientStream(client), client(client), bus(bus) {
+			this->client.setMaxDataLength(DS2_BRIDGE_COMMAND);
+		}
+		
+		void setSelectPin(uint8_t pin, uint8_t activeLevel = LOW);
+		
+		// Call in loop; returns result of bus response handled now, RECEIVE_WAITING if none
+		ReceiveType poll();
+		DS2Frame getFrame() { return lastFrame; } // last response forwarded to client
+		bool isBusy() { return sending || queued != 0; }
+		
+		uint8_t getQueued() { return queued; }
+		uint32_t getForwarded() { return forwarded; }
+		uint32_t getTimeouts() { return timeouts; }
+		uint32_t getQueueDelay() { return queueDelay; } // us, averaged
+		uint32_t getForwardDelay() { return forwardDelay; } // us, averaged
+		uint32_t getMaxAddedLatency() { return maxAdded; } // us, worst queue + forward delay
+		void resetStats();
+		
+	private:
+		struct Request {
+			uint8_t data[DS2_BRIDGE_COMMAND];
+			uint32_t receivedAt; // micros
+		};
+		
+		Stream &clientStream;
+		DS2 client;
+		DS2 &bus;
+		Request queue[DS2_BRIDGE_QUEUE];
+		uint8_t head = 0, queued = 0;
+		uint8_t busData[MAX_DATA_LENGTH];
+		DS2Frame lastFrame;
+		bool sending = false;
+		uint32_t sentDelay = 0;
+		
+		uint8_t selectPin = DS2_BRIDGE_NO_PIN;
+		uint8_t selectActive = LOW;
+		bool selected = false;
+		
+		uint32_t forwarded = 0, timeouts = 0;
+		uint32_t queueDelay = 0, forwardDelay = 0, maxAdded = 0;
+		
+		void select(bool active);
+		void readClient();
+		void startNext();
+};
+
+#endif /* DS2Bridge_h */
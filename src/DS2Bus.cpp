@@ -0,0 +1,172 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Bus.h>
+
+// Weight of newest sample in averaged response interval is 1/2^INTERVAL_SHIFT
+#define INTERVAL_SHIFT 3
+
+
+uint8_t DS2Bus::addModule(uint8_t address, DS2BusHandler handler, void *context, uint8_t share) {
+	if(size >= DS2_BUS_MODULES) return DS2_BUS_NONE;
+	DS2BusModule &module = modules[size];
+	module.address = address;
+	module.share = share ? share : 1;
+	module.handler = handler;
+	module.context = context;
+	module.commandCount = 0;
+	module.nextCommand = 0;
+	module.pending = nullptr;
+	module.enabled = true;
+	module.pass = minPass(); // starts level with others instead of catching up
+	module.lastResponse = 0;
+	module.interval = 0;
+	module.responses = module.timeouts = module.bad = 0;
+	return size++;
+}
+
+bool DS2Bus::addCommand(uint8_t module, uint8_t command[]) {
+	if(module >= size || modules[module].commandCount >= DS2_BUS_COMMANDS) return false;
+	modules[module].commands[modules[module].commandCount++] = command;
+	return true;
+}
+
+bool DS2Bus::request(uint8_t module, uint8_t command[]) {
+	if(module >= size || modules[module].pending != nullptr) return false;
+	modules[module].pending = command;
+	return true;
+}
+
+void DS2Bus::setShare(uint8_t module, uint8_t share) {
+	if(module < size) modules[module].share = share ? share : 1;
+}
+
+void DS2Bus::setEnabled(uint8_t module, bool enabled) {
+	if(module >= size) return;
+	if(enabled && !modules[module].enabled) modules[module].pass = minPass();
+	modules[module].enabled = enabled;
+}
+
+void DS2Bus::clear() {
+	if(current != DS2_BUS_NONE) ds2.newCommand();
+	current = DS2_BUS_NONE;
+	lastModule = DS2_BUS_NONE;
+	size = 0;
+}
+
+uint8_t DS2Bus::find(uint8_t address) {
+	for(uint8_t i = 0; i < size; i++) {
+		if(modules[i].address == address) return i;
+	}
+	return DS2_BUS_NONE;
+}
+
+uint32_t DS2Bus::minPass() {
+	bool found = false;
+	uint32_t pass = 0;
+	for(uint8_t i = 0; i < size; i++) {
+		if(!modules[i].enabled) continue;
+		if(!found || (int32_t) (modules[i].pass - pass) < 0) pass = modules[i].pass;
+		found = true;
+	}
+	return pass;
+}
+
+// Stride scheduling - module with lowest pass that has something to send
+uint8_t DS2Bus::pickNext() {
+	uint8_t next = DS2_BUS_NONE;
+	for(uint8_t i = 0; i < size; i++) {
+		DS2BusModule &module = modules[i];
+		if(!module.enabled || (module.commandCount == 0 && module.pending == nullptr)) continue;
+		if(next == DS2_BUS_NONE || (int32_t) (module.pass - modules[next].pass) < 0) next = i;
+	}
+	return next;
+}
+
+void DS2Bus::startNext() {
+	uint8_t next = pickNext();
+	if(next == DS2_BUS_NONE) return;
+	DS2BusModule &module = modules[next];
+	uint8_t *command = module.pending;
+	if(command != nullptr) module.pending = nullptr;
+	else {
+		if(module.nextCommand >= module.commandCount) module.nextCommand = 0;
+		command = module.commands[module.nextCommand++];
+	}
+	// DS2 refuses while other message is still pending - keep command for next try and don't charge the pass
+	if(ds2.sendCommand(command) == 0) {
+		module.pending = command;
+		return;
+	}
+	module.pass += DS2_BUS_STRIDE / module.share;
+	current = next;
+}
+
+ReceiveType DS2Bus::poll() {
+	if(current == DS2_BUS_NONE) {
+		startNext();
+		return RECEIVE_WAITING;
+	}
+	ReceiveType result = ds2.receiveData(buffer);
+	if(result == RECEIVE_WAITING) return result;
+	
+	uint8_t target = current;
+	DS2Frame frame;
+	if(result != RECEIVE_TIMEOUT) {
+		frame = ds2.getFrame();
+		if(frame.getDevice() != modules[target].address) {
+			target = find(frame.getDevice());
+			if(target == DS2_BUS_NONE) unrouted++;
+		}
+	}
+	
+	// Next request goes out before handler runs, buffer is only touched again by next poll()
+	current = DS2_BUS_NONE;
+	startNext();
+	lastModule = target;
+	if(target == DS2_BUS_NONE) return result;
+	
+	DS2BusModule &module = modules[target];
+	if(result == RECEIVE_OK) {
+		uint32_t now = micros();
+		if(module.lastResponse != 0) {
+			uint32_t interval = now - module.lastResponse;
+			if(module.interval == 0) module.interval = interval;
+			else module.interval = module.interval - (module.interval >> INTERVAL_SHIFT) + (interval >> INTERVAL_SHIFT);
+		}
+		module.lastResponse = now;
+		module.responses++;
+	} else if(result == RECEIVE_TIMEOUT) module.timeouts++;
+	else module.bad++;
+	
+	if(module.handler != nullptr) module.handler(target, result, frame, module.context);
+	return result;
+}
+
+float DS2Bus::getAchievedRate(uint8_t module) {
+	if(module >= size || modules[module].interval == 0) return 0;
+	return 1000000.0 / modules[module].interval;
+}
+
+void DS2Bus::resetStats() {
+	for(uint8_t i = 0; i < size; i++) {
+		modules[i].lastResponse = 0;
+		modules[i].interval = 0;
+		modules[i].responses = modules[i].timeouts = modules[i].bad = 0;
+	}
+	unrouted = 0;
+}
@@ -0,0 +1,115 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Bus
+*	Talks to several modules on one K-line - DME (0x12), EGS (0x32), IHKA and so on. Owns the DS2 it's given,
+*	keeps one request on the bus at a time and hands every response to handler of module whose address is in it.
+*	DS2 follows address of each request, so resync on device byte always looks for the module being asked.
+
+*	Bus budget (~15-30 rps at 9600) is shared by module share - module with share 3 gets 3 requests
+	for every 1 of module with share 1 while both have something to send. Each module cycles through its commands.
+*	Every DS2Bus has own response buffer, so more buses (Serial1, Serial2) are just more DS2Bus objects
+	polled one after another in loop - poll() never blocks.
+
+*	Usage:
+	DS2 kline(Serial2);
+	DS2Bus bus(kline);
+	uint8_t dme = bus.addModule(0x12, onDme, nullptr, 3);
+	uint8_t egs = bus.addModule(0x32, onEgs);
+	bus.addCommand(dme, generalValues);
+	bus.addCommand(egs, gearboxValues);
+	void loop() {
+		bus.poll();
+	}
+**/
+
+#ifndef DS2Bus_h
+#define DS2Bus_h
+
+#include "DS2.h"
+
+// Max modules on one bus
+#ifndef DS2_BUS_MODULES
+#define DS2_BUS_MODULES 4
+#endif
+
+// Max polled commands per module
+#ifndef DS2_BUS_COMMANDS
+#define DS2_BUS_COMMANDS 4
+#endif
+
+#define DS2_BUS_NONE 0xFF
+#define DS2_BUS_STRIDE 0x10000UL
+
+typedef void (*DS2BusHandler)(uint8_t module, ReceiveType result, const DS2Frame &frame, void *context);
+
+
+struct DS2BusModule {
+	uint8_t address;
+	uint8_t share;
+	DS2BusHandler handler;
+	void *context;
+	uint8_t *commands[DS2_BUS_COMMANDS];
+	uint8_t commandCount;
+	uint8_t nextCommand;
+	uint8_t *pending; // one shot request, goes before polled commands
+	bool enabled;
+	uint32_t pass; // stride scheduling position, lowest goes next
+	uint32_t lastResponse; // micros
+	uint32_t interval; // averaged time between responses in us
+	uint32_t responses, timeouts, bad;
+};
+
+
+class DS2Bus {
+	public:
+		DS2Bus(DS2 &ds2):ds2(ds2) {}
+		
+		// Returns module index or DS2_BUS_NONE if full; share is its weight in bus budget
+		uint8_t addModule(uint8_t address, DS2BusHandler handler, void *context = nullptr, uint8_t share = 1);
+		bool addCommand(uint8_t module, uint8_t command[]); // polled in turn with other commands of module
+		bool request(uint8_t module, uint8_t command[]); // sent once when module's turn comes, false if one is waiting already
+		void setShare(uint8_t module, uint8_t share);
+		void setEnabled(uint8_t module, bool enabled);
+		void clear();
+		
+		// Call in loop; returns result that came in now (RECEIVE_WAITING if none) after handler got it
+		ReceiveType poll();
+		uint8_t getModule() { return lastModule; } // which module poll() result belongs to
+		uint8_t find(uint8_t address); // module index of address
+		
+		uint8_t getSize() { return size; }
+		float getAchievedRate(uint8_t module); // responses per second
+		const DS2BusModule &getEntry(uint8_t module) { return modules[module]; }
+		uint32_t getUnrouted() { return unrouted; } // responses from address no module is registered for
+		void resetStats();
+		
+	private:
+		DS2 &ds2;
+		DS2BusModule modules[DS2_BUS_MODULES];
+		uint8_t buffer[MAX_DATA_LENGTH];
+		uint8_t size = 0;
+		uint8_t current = DS2_BUS_NONE;
+		uint8_t lastModule = DS2_BUS_NONE;
+		uint32_t unrouted = 0;
+		
+		uint8_t pickNext();
+		void startNext();
+		uint32_t minPass();
+};
+
+#endif /* DS2Bus_h */
@@ -0,0 +1,173 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Capture.h>
+
+
+int DS2Capture::read() {
+	int value = stream.read();
+	if(value >= 0) {
+		uint8_t byte = value;
+		received(&byte, 1, micros());
+	}
+	return value;
+}
+
+size_t DS2Capture::readBytes(char *buffer, size_t length) {
+	size_t count = stream.readBytes(buffer, length);
+	received((const uint8_t *) buffer, count, micros());
+	return count;
+}
+
+size_t DS2Capture::write(const uint8_t *buffer, size_t size) {
+	uint32_t timeStamp = micros();
+	size_t count = stream.write(buffer, size);
+	log(DS2_CAPTURE_TX, buffer, count, timeStamp);
+	
+	// Slow send writes command byte by byte, so new command starts only when previous echo is complete
+	if(echoDone >= echoLength) echoLength = echoDone = 0;
+	for(size_t i = 0; i < count; i++, echoLength++) {
+		if(echoLength < DS2_CAPTURE_ECHO_LENGTH) echo[echoLength] = buffer[i];
+	}
+	return count;
+}
+
+void DS2Capture::received(const uint8_t bytes[], size_t length, uint32_t timeStamp) {
+	size_t echoed = 0;
+	while(echoed < length && echoDone < echoLength && (echoDone >= DS2_CAPTURE_ECHO_LENGTH || echo[echoDone] == bytes[echoed])) {
+		echoed++;
+		echoDone++;
+	}
+	if(echoed < length && echoDone < echoLength) echoLength = echoDone = 0; // collision, rest is what was on wire
+	log(DS2_CAPTURE_ECHO, bytes, echoed, timeStamp);
+	log(DS2_CAPTURE_RX, bytes + echoed, length - echoed, timeStamp);
+}
+
+void DS2Capture::log(uint8_t direction, const uint8_t bytes[], size_t length, uint32_t timeStamp) {
+	while(length > 0) {
+		uint8_t chunk = length < 255 ? length : 255;
+		if(!logger.log(direction, bytes, chunk, timeStamp)) lost++;
+		bytes += chunk;
+		length -= chunk;
+	}
+}
+
+
+void DS2Replay::rewind() {
+	position = 0;
+	haveRecord = false;
+	started = finished = false;
+	writtenHead = writtenTail = loopedHead = loopedTail = 0;
+	writtenCount = loopedCount = 0;
+	records = mismatches = 0;
+}
+
+bool DS2Replay::isFinished() {
+	advance();
+	return finished && loopedCount == 0;
+}
+
+bool DS2Replay::isDue() {
+	if(replaySpeed <= 0) return true;
+	int32_t ahead = record.timeStamp - anchorCapture;
+	if(ahead <= 0) return true;
+	return (float) (micros() - anchorAt) * replaySpeed >= (float) ahead;
+}
+
+uint16_t DS2Replay::advance() {
+	while(true) {
+		if(!haveRecord) {
+			if(!DS2Logger::parse(capture, length, position, record)) {
+				finished = true;
+				return loopedCount;
+			}
+			haveRecord = true;
+			offset = 0;
+			if(!started) {
+				started = true;
+				anchorAt = micros();
+				anchorCapture = record.timeStamp;
+			}
+		}
+		
+		if(record.command == DS2_CAPTURE_TX) {
+			while(offset < record.length && writtenCount > 0) {
+				if(written[writtenTail++] != record.payload[offset]) mismatches++;
+				writtenCount--;
+				offset++;
+			}
+			if(offset < record.length) return loopedCount; // DS2 didn't send it yet
+			// Timeline continues from our request, response keeps its distance from it
+			anchorAt = writtenAt;
+			anchorCapture = record.timeStamp;
+			records++;
+			haveRecord = false;
+			continue;
+		}
+		bool played = record.command == DS2_CAPTURE_RX || (record.command == DS2_CAPTURE_ECHO && !loopback);
+		if(!played || record.length == 0) {
+			haveRecord = false;
+			continue;
+		}
+		if(offset == 0 && !isDue()) return loopedCount;
+		return loopedCount + record.length - offset;
+	}
+}
+
+int DS2Replay::available() {
+	return advance();
+}
+
+int DS2Replay::peek() {
+	if(advance() == 0) return -1;
+	return loopedCount ? looped[loopedTail] : record.payload[offset];
+}
+
+int DS2Replay::read() {
+	if(advance() == 0) return -1;
+	if(loopedCount) {
+		loopedCount--;
+		return looped[loopedTail++];
+	}
+	uint8_t value = record.payload[offset++];
+	if(offset == record.length) {
+		haveRecord = false;
+		records++;
+	}
+	return value;
+}
+
+size_t DS2Replay::readBytes(char *buffer, size_t length) {
+	size_t count = 0;
+	while(count < length && available() > 0) buffer[count++] = (char) read();
+	return count;
+}
+
+size_t DS2Replay::write(const uint8_t *buffer, size_t size) {
+	writtenAt = micros();
+	for(size_t i = 0; i < size; i++) {
+		if(writtenCount < sizeof(written)) {
+			written[writtenHead++] = buffer[i];
+			writtenCount++;
+		} else mismatches++; // far ahead of capture
+		if(loopback && loopedCount < sizeof(looped)) {
+			looped[loopedHead++] = buffer[i];
+			loopedCount++;
+		}
+	}
+	return size;
+}
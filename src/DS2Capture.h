@@ -0,0 +1,137 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Capture / DS2Replay
+*	Raw K-line capture for reproducing field issues on the bench. DS2Capture sits between DS2 and serial and logs
+*	every chunk that goes through it with micros timestamp and direction - TX (written by us), echo (our bytes coming
+*	back from K-line) and RX (everything else, ECU responses and bytes from other testers). Records go to DS2Logger,
+*	so capture never waits for SD card: command byte of DS2Logger record is direction, timestamp is micros when
+*	chunk was written or read (same as first byte time for DS2Sniffer records).
+	
+*	DS2Replay is Stream that plays capture back into DS2 - on ESP32 from RAM, on PC from file so parser and
+	scheduler changes can be tested on real traffic. RX and echo bytes become available at their captured time,
+	scaled by setSpeed: 1 - real time, 10 - ten times faster, 0 - as fast as possible. TX records are gates: replay
+	waits until DS2 writes that many bytes and then continues timeline from time of write, so response comes same
+	time after request as it did in car. Written bytes that differ from captured ones are counted as mismatches.
+	Captures from DS2Sniffer have requests as TX and no echo - use setLoopback(true), then written bytes come
+	straight back as echo like on real K-line (and captured echo records are skipped).
+
+*	Usage:
+	DS2Capture capture(Serial2, logger);
+	DS2 DS2(capture); // everything DS2 does is captured
+	
+	DS2Replay replay(captureData, captureLength);
+	replay.setSpeed(0);
+	DS2 DS2(replay);
+	while(!replay.isFinished()) DS2.obtainValues(generalValues, data);
+**/
+
+#ifndef DS2Capture_h
+#define DS2Capture_h
+
+#include "DS2Logger.h"
+
+// Directions, stored as DS2Logger command byte
+#define DS2_CAPTURE_TX 'T'
+#define DS2_CAPTURE_ECHO 'E'
+#define DS2_CAPTURE_RX 'R'
+
+// Own bytes remembered to tell echo from RX, longer commands are not compared past this
+#ifndef DS2_CAPTURE_ECHO_LENGTH
+	#if defined(__AVR__)
+		#define DS2_CAPTURE_ECHO_LENGTH 16
+	#else
+		#define DS2_CAPTURE_ECHO_LENGTH 255
+	#endif
+#endif
+
+
+class DS2Capture : public Stream {
+	public:
+		DS2Capture(Stream &stream, DS2Logger &logger):stream(stream), logger(logger) {}
+		
+		int available() { return stream.available(); }
+		int peek() { return stream.peek(); }
+		int read();
+		size_t readBytes(char *buffer, size_t length); // virtual on ESP32, elsewhere bytes go through read()
+		size_t write(uint8_t value) { return write(&value, 1); }
+		size_t write(const uint8_t *buffer, size_t size);
+		int availableForWrite() { return stream.availableForWrite(); }
+		void flush() { stream.flush(); }
+		
+		uint32_t getLost() { return lost; } // chunks logger dropped
+		
+	private:
+		Stream &stream;
+		DS2Logger &logger;
+		uint8_t echo[DS2_CAPTURE_ECHO_LENGTH];
+		uint16_t echoLength = 0, echoDone = 0; // written and already seen back
+		uint32_t lost = 0;
+		
+		void received(const uint8_t bytes[], size_t length, uint32_t timeStamp);
+		void log(uint8_t direction, const uint8_t bytes[], size_t length, uint32_t timeStamp);
+};
+
+
+class DS2Replay : public Stream {
+	public:
+		// Capture stays where it is, it has to be valid while replaying
+		DS2Replay(const uint8_t capture[], uint32_t length):capture(capture), length(length) {}
+		
+		void setSpeed(float speed) { replaySpeed = speed; } // 1 - real time, 0 - as fast as possible
+		void setLoopback(bool loop) { loopback = loop; }
+		void rewind();
+		bool isFinished(); // all records played
+		
+		int available();
+		int read();
+		int peek();
+		size_t readBytes(char *buffer, size_t length); // takes only bytes that are due, doesn't wait
+		size_t write(uint8_t value) { return write(&value, 1); }
+		size_t write(const uint8_t *buffer, size_t size);
+		
+		uint32_t getRecords() { return records; } // played
+		uint32_t getMismatches() { return mismatches; } // written bytes different from captured TX
+		
+	private:
+		const uint8_t *capture;
+		uint32_t length;
+		uint32_t position = 0;
+		DS2LogRecord record;
+		bool haveRecord = false;
+		uint8_t offset = 0; // bytes of record already played
+		
+		float replaySpeed = 1;
+		bool loopback = false;
+		bool started = false, finished = false;
+		uint32_t anchorAt = 0, anchorCapture = 0; // micros here and in capture that are same moment
+		
+		uint8_t written[256]; // bytes written by DS2 not matched with TX record yet, uint8_t indexes wrap
+		uint8_t writtenHead = 0, writtenTail = 0;
+		uint16_t writtenCount = 0;
+		uint32_t writtenAt = 0;
+		uint8_t looped[256]; // loopback echo
+		uint8_t loopedHead = 0, loopedTail = 0;
+		uint16_t loopedCount = 0;
+		
+		uint32_t records = 0, mismatches = 0;
+		
+		uint16_t advance(); // returns bytes readable now
+		bool isDue();
+};
+
+#endif /* DS2Capture_h */
@@ -0,0 +1,132 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2ChangeTracker.h>
+
+
+// Word at a time XOR of both payloads, any set bit means something changed
+static bool payloadDiffers(const uint8_t a[], const uint8_t b[], uint8_t length) {
+	uintptr_t diff = 0;
+	uint16_t i = 0;
+	for(; i + sizeof(uintptr_t) <= length; i += sizeof(uintptr_t)) {
+		uintptr_t wordA, wordB;
+		memcpy(&wordA, a + i, sizeof(wordA));
+		memcpy(&wordB, b + i, sizeof(wordB));
+		diff |= wordA ^ wordB;
+	}
+	for(; i < length; i++) diff |= a[i] ^ b[i];
+	return diff != 0;
+}
+
+
+DS2ChangeTracker::DS2ChangeTracker(const DS2ChannelTable &table):table(table) {
+	memset(deadbands, 0, sizeof(deadbands));
+	memset(silences, 0, sizeof(silences));
+	memset(last, 0, sizeof(last));
+	memset(lastAt, 0, sizeof(lastAt));
+	reset();
+}
+
+void DS2ChangeTracker::setDeadband(uint8_t channel, int32_t deadband) {
+	if(channel < DS2_CHANGE_CHANNELS) deadbands[channel] = deadband < 0 ? -deadband : deadband;
+}
+
+void DS2ChangeTracker::setMaxSilence(uint8_t channel, uint32_t silenceMs) {
+	if(channel >= DS2_CHANGE_CHANNELS) return;
+	silences[channel] = silenceMs;
+	if(silenceMs != 0) silenceUsed = true;
+	nextDue = millis(); // recalculated on next update
+}
+
+void DS2ChangeTracker::setDeadband(int32_t deadband) {
+	for(uint8_t i = 0; i < DS2_CHANGE_CHANNELS; i++) setDeadband(i, deadband);
+}
+
+void DS2ChangeTracker::setMaxSilence(uint32_t silenceMs) {
+	for(uint8_t i = 0; i < DS2_CHANGE_CHANNELS; i++) setMaxSilence(i, silenceMs);
+}
+
+void DS2ChangeTracker::reset() {
+	primed = false;
+	previousLength = 0;
+}
+
+uint64_t DS2ChangeTracker::update(const DS2Frame &frame, int32_t values[], uint32_t now) {
+	frames++;
+	const uint8_t *payload = frame.getPayload();
+	uint8_t length = frame.getPayloadLength();
+	bool all = !primed || length != previousLength;
+#if DS2_CHANGE_PAYLOAD < 255
+	if(length > DS2_CHANGE_PAYLOAD) all = true;
+#endif
+	bool due = silenceUsed && (int32_t) (now - nextDue) >= 0;
+	if(!all && !due && !payloadDiffers(previous, payload, length)) {
+		unchanged++;
+		return 0;
+	}
+	
+	uint8_t count = table.getCount() < DS2_CHANGE_CHANNELS ? table.getCount() : DS2_CHANGE_CHANNELS;
+	uint64_t mask = 0;
+	for(uint8_t i = 0; i < count; i++) {
+		const DS2Channel &channel = table.getChannel(i);
+		bool silent = due && silences[i] != 0 && now - lastAt[i] >= silences[i]; // nothing is due before nextDue
+		bool moved = all;
+		if(!moved) {
+			// 1-4 bytes, plain loop is cheaper than memcmp call
+			uint16_t end = channel.offset + channel.width < length ? channel.offset + channel.width : length;
+			uint8_t diff = 0;
+			for(uint16_t j = channel.offset; j < end; j++) diff |= previous[j] ^ payload[j];
+			moved = diff != 0;
+		}
+		if(!moved && !silent) continue;
+		
+		int32_t value = table.getValue(frame, i);
+		if(!all && !silent) {
+			// Against last reported value, so slow drift is reported once it adds up
+			int64_t delta = (int64_t) value - last[i];
+			if(delta < 0) delta = -delta;
+			if(delta <= deadbands[i]) continue;
+		}
+		mask |= (uint64_t) 1 << i;
+		values[i] = value;
+		last[i] = value;
+		lastAt[i] = now;
+		reported++;
+	}
+	
+#if DS2_CHANGE_PAYLOAD < 255
+	if(length > DS2_CHANGE_PAYLOAD) length = 0; // not kept, next frame is compared as all changed
+#endif
+	memcpy(previous, payload, length);
+	previousLength = length;
+	primed = true;
+	if(silenceUsed && (mask != 0 || due)) findNextDue(now);
+	return mask;
+}
+
+void DS2ChangeTracker::findNextDue(uint32_t now) {
+	uint32_t soonest = 0xFFFFFFFF;
+	uint8_t count = table.getCount() < DS2_CHANGE_CHANNELS ? table.getCount() : DS2_CHANGE_CHANNELS;
+	for(uint8_t i = 0; i < count; i++) {
+		if(silences[i] == 0) continue;
+		uint32_t elapsed = now - lastAt[i];
+		uint32_t left = elapsed >= silences[i] ? 0 : silences[i] - elapsed;
+		if(left < soonest) soonest = left;
+	}
+	nextDue = now + soonest;
+	if(soonest == 0xFFFFFFFF) silenceUsed = false;
+}
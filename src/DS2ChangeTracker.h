@@ -0,0 +1,102 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2ChangeTracker
+*	Sits between channel decoding and display/log/Bluetooth, so they get only channels that really changed.
+*	update() compares new payload with previous one word at a time (XOR), identical frame costs few word compares
+*	and no decoding. Channels whose bytes differ are decoded and reported if value moved more than their deadband;
+*	every channel is also reported when it was silent for its max silence time, so slow values still refresh.
+
+*	Result is bitmask of reported channels (bit n - channel n of table) plus their values in values[n]; values of other
+*	channels are left as they were, so same array always holds latest reported value of everything.
+
+*	Usage:
+	DS2ChangeTracker tracker(table);
+	tracker.setDeadband(coolant, DS2_SCALE(0.5, 8)); // fixed point, same scale as channel value
+	tracker.setMaxSilence(coolant, 5000);
+	...
+	if(DS2.receiveData(data) == RECEIVE_OK) {
+		uint64_t changed = tracker.update(DS2.getFrame(), values);
+		for(uint8_t i = 0; changed; i++, changed >>= 1) if(changed & 1) draw(i, values[i]);
+	}
+**/
+
+#ifndef DS2ChangeTracker_h
+#define DS2ChangeTracker_h
+
+#include "DS2Channel.h"
+
+// Channels tracked, one bit each in uint64_t mask
+#ifndef DS2_CHANGE_CHANNELS
+	#if defined(__AVR__)
+		#define DS2_CHANGE_CHANNELS 16
+	#else
+		#define DS2_CHANGE_CHANNELS 64
+	#endif
+#endif
+#if DS2_CHANGE_CHANNELS > 64
+	#error "DS2_CHANGE_CHANNELS can't be over 64"
+#endif
+
+// Longest payload compared, longer frames are treated as all changed
+#ifndef DS2_CHANGE_PAYLOAD
+	#if defined(__AVR__)
+		#define DS2_CHANGE_PAYLOAD 64
+	#else
+		#define DS2_CHANGE_PAYLOAD 255
+	#endif
+#endif
+
+
+class DS2ChangeTracker {
+	public:
+		// Table is copied, its channel array (or DS2Profile it came from) must stay valid
+		DS2ChangeTracker(const DS2ChannelTable &table);
+		
+		// Value change (fixed point, like DS2ChannelTable::decode) needed to report channel, 0 - any change
+		void setDeadband(uint8_t channel, int32_t deadband);
+		// ms after which channel is reported even if it didn't change, 0 - never
+		void setMaxSilence(uint8_t channel, uint32_t silenceMs);
+		// Same for all channels
+		void setDeadband(int32_t deadband);
+		void setMaxSilence(uint32_t silenceMs);
+		
+		// Returns mask of channels reported for this frame, their values are written to values[]
+		uint64_t update(const DS2Frame &frame, int32_t values[], uint32_t now = millis());
+		void reset(); // next update reports everything
+		
+		uint32_t getFrames() { return frames; }
+		uint32_t getUnchanged() { return unchanged; } // frames that were same as previous, nothing decoded
+		uint32_t getReported() { return reported; } // channel values reported in total
+		
+	private:
+		DS2ChannelTable table; // copy, DS2Profile::getTable() gives temporary
+		uint8_t previous[DS2_CHANGE_PAYLOAD];
+		uint8_t previousLength = 0;
+		bool primed = false;
+		int32_t deadbands[DS2_CHANGE_CHANNELS];
+		uint32_t silences[DS2_CHANGE_CHANNELS];
+		int32_t last[DS2_CHANGE_CHANNELS]; // last reported value
+		uint32_t lastAt[DS2_CHANGE_CHANNELS];
+		uint32_t nextDue = 0; // earliest max silence deadline
+		bool silenceUsed = false;
+		uint32_t frames = 0, unchanged = 0, reported = 0;
+		
+		void findNextDue(uint32_t now);
+};
+
+#endif /* DS2ChangeTracker_h */
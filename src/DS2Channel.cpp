@@ -0,0 +1,132 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Channel.h>
+
+
+// Value fully inside payload - one switch on width and flags instead of byte loop
+static inline int32_t readInside(const uint8_t bytes[], uint8_t width, uint8_t flags) {
+	switch((width > 4 ? 4 : width) | (flags & (DS2_CHANNEL_SIGNED | DS2_CHANNEL_LITTLE_ENDIAN)) << 3) {
+		case 1:
+		case 1 | DS2_CHANNEL_LITTLE_ENDIAN << 3:
+			return bytes[0];
+		case 1 | DS2_CHANNEL_SIGNED << 3:
+		case 1 | (DS2_CHANNEL_SIGNED | DS2_CHANNEL_LITTLE_ENDIAN) << 3:
+			return (int8_t) bytes[0];
+		case 2:
+			return (uint16_t) (bytes[0] << 8 | bytes[1]);
+		case 2 | DS2_CHANNEL_SIGNED << 3:
+			return (int16_t) (bytes[0] << 8 | bytes[1]);
+		case 2 | DS2_CHANNEL_LITTLE_ENDIAN << 3:
+			return (uint16_t) (bytes[1] << 8 | bytes[0]);
+		case 2 | (DS2_CHANNEL_SIGNED | DS2_CHANNEL_LITTLE_ENDIAN) << 3:
+			return (int16_t) (bytes[1] << 8 | bytes[0]);
+		case 4:
+		case 4 | DS2_CHANNEL_SIGNED << 3:
+			return (int32_t) ((uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | bytes[3]);
+		case 4 | DS2_CHANNEL_LITTLE_ENDIAN << 3:
+		case 4 | (DS2_CHANNEL_SIGNED | DS2_CHANNEL_LITTLE_ENDIAN) << 3:
+			return (int32_t) ((uint32_t) bytes[3] << 24 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[1] << 8 | bytes[0]);
+		default: {
+			// 3 bytes or empty
+			uint32_t raw = 0;
+			if(flags & DS2_CHANNEL_LITTLE_ENDIAN) for(uint8_t i = width; i > 0; i--) raw = raw << 8 | bytes[i - 1];
+			else for(uint8_t i = 0; i < width; i++) raw = raw << 8 | bytes[i];
+			if((flags & DS2_CHANNEL_SIGNED) && width == 3) return (int32_t) (raw << 8) >> 8;
+			return (int32_t) raw;
+		}
+	}
+}
+
+
+DS2ChannelTable::DS2ChannelTable(const DS2Channel channels[], uint8_t count):channels(channels), count(count) {
+	for(uint8_t i = 0; i < count; i++) {
+		uint16_t end = channels[i].offset + (channels[i].width > 4 ? 4 : channels[i].width);
+		if(end > needed) needed = end;
+	}
+}
+
+int32_t DS2ChannelTable::readRaw(const DS2Frame &frame, uint8_t offset, uint8_t width, uint8_t flags) {
+	if(width > 4) width = 4;
+	if(offset + width <= frame.getPayloadLength()) return readInside(frame.getPayload() + offset, width, flags);
+	
+	// Partly outside, missing bytes read as 0
+	bool little = flags & DS2_CHANNEL_LITTLE_ENDIAN;
+	uint32_t raw = 0;
+	if(little) for(uint8_t i = width; i > 0; i--) raw = raw << 8 | frame.getByte(offset + i - 1);
+	else for(uint8_t i = 0; i < width; i++) raw = raw << 8 | frame.getByte(offset + i);
+	if((flags & DS2_CHANNEL_SIGNED) && width != 0 && width < 4) {
+		uint8_t extend = 32 - 8 * width;
+		return (int32_t) (raw << extend) >> extend;
+	}
+	return (int32_t) raw;
+}
+
+// 2^-shift, multiplying is much cheaper than dividing on FPU-less MCUs
+static const float fractionScales[32] = {
+	1.0f / (1UL << 0), 1.0f / (1UL << 1), 1.0f / (1UL << 2), 1.0f / (1UL << 3), 1.0f / (1UL << 4), 1.0f / (1UL << 5), 1.0f / (1UL << 6), 1.0f / (1UL << 7),
+	1.0f / (1UL << 8), 1.0f / (1UL << 9), 1.0f / (1UL << 10), 1.0f / (1UL << 11), 1.0f / (1UL << 12), 1.0f / (1UL << 13), 1.0f / (1UL << 14), 1.0f / (1UL << 15),
+	1.0f / (1UL << 16), 1.0f / (1UL << 17), 1.0f / (1UL << 18), 1.0f / (1UL << 19), 1.0f / (1UL << 20), 1.0f / (1UL << 21), 1.0f / (1UL << 22), 1.0f / (1UL << 23),
+	1.0f / (1UL << 24), 1.0f / (1UL << 25), 1.0f / (1UL << 26), 1.0f / (1UL << 27), 1.0f / (1UL << 28), 1.0f / (1UL << 29), 1.0f / (1UL << 30), 1.0f / (1UL << 31)
+};
+
+int32_t DS2ChannelTable::getRaw(const DS2Frame &frame, uint8_t index) const {
+	if(index >= count) return 0;
+	const DS2Channel &channel = channels[index];
+	return readRaw(frame, channel.offset, channel.width, channel.flags);
+}
+
+int32_t DS2ChannelTable::getValue(const DS2Frame &frame, uint8_t index) const {
+	if(index >= count) return 0;
+	const DS2Channel &channel = channels[index];
+	return readRaw(frame, channel.offset, channel.width, channel.flags) * channel.multiplier + channel.addend;
+}
+
+uint8_t DS2ChannelTable::decode(const DS2Frame &frame, int32_t values[]) const {
+	// Length checked once for whole table, short frame goes through bounds checked reads
+	if(frame.getPayloadLength() >= needed) {
+		const uint8_t *payload = frame.getPayload();
+		for(uint8_t i = 0; i < count; i++) {
+			const DS2Channel &channel = channels[i];
+			values[i] = readInside(payload + channel.offset, channel.width, channel.flags) * channel.multiplier + channel.addend;
+		}
+	} else {
+		for(uint8_t i = 0; i < count; i++) values[i] = getValue(frame, i);
+	}
+	return count;
+}
+
+uint8_t DS2ChannelTable::decode(const DS2Frame &frame, float values[]) const {
+	if(frame.getPayloadLength() >= needed) {
+		const uint8_t *payload = frame.getPayload();
+		for(uint8_t i = 0; i < count; i++) {
+			const DS2Channel &channel = channels[i];
+			int32_t fixed = readInside(payload + channel.offset, channel.width, channel.flags) * channel.multiplier + channel.addend;
+			values[i] = fixed * fractionScales[channel.shift & 31];
+		}
+	} else {
+		for(uint8_t i = 0; i < count; i++) values[i] = getValue(frame, i) * fractionScales[channels[i].shift & 31];
+	}
+	return count;
+}
+
+uint8_t DS2ChannelTable::find(const char *name) const {
+	for(uint8_t i = 0; i < count; i++) {
+		if(strcmp(channels[i].name, name) == 0) return i;
+	}
+	return 255;
+}
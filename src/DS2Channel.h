@@ -0,0 +1,86 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Channel
+*	Declarative description of values inside a response and decoder that turns one frame into all of them in single pass.
+
+*	Every channel is: value = (raw * multiplier + addend) / 2^shift
+	-	raw is 1-4 bytes at payload offset (same offsets as DS2::getByte), big endian unless DS2_CHANNEL_LITTLE_ENDIAN
+	-	decode(frame, int32_t values[]) gives fixed point result (raw * multiplier + addend) with 'shift' fraction bits,
+		with shift 0 it's just integer in your units - no FPU needed
+	-	decode(frame, float values[]) gives real value
+	-	raw * multiplier has to fit in 32 bits, so for 16 bit raw values keep multiplier under 2^15
+
+*	Example for MS43 general values:
+	const DS2Channel msChannels[] = {
+		//	name		offset	width	flags					multiplier				addend					shift
+		{"rpm",			0,		2,		0,						1,						0,						0},
+		{"coolant",		4,		1,		0,						DS2_SCALE(0.75, 8),		DS2_SCALE(-48, 8),		8},
+		{"battery",		22,		1,		0,						DS2_SCALE(0.1, 16),		0,						16},
+	};
+	DS2ChannelTable table(msChannels, 3);
+	float values[3];
+	table.decode(DS2.getFrame(), values);
+**/
+
+#ifndef DS2Channel_h
+#define DS2Channel_h
+
+#include "DS2Frame.h"
+
+// Channel flags
+#define DS2_CHANNEL_SIGNED 0x01
+#define DS2_CHANNEL_LITTLE_ENDIAN 0x02
+
+// Fixed point constant with 'shift' fraction bits, rounded - use it for multiplier and addend
+#define DS2_SCALE(value, shift) ((int32_t) ((value) * (float) (1UL << (shift)) + ((value) < 0 ? -0.5 : 0.5)))
+
+
+struct DS2Channel {
+	const char *name;
+	uint8_t offset;
+	uint8_t width; // 1 - 4 bytes
+	uint8_t flags;
+	int32_t multiplier;
+	int32_t addend;
+	uint8_t shift;
+};
+
+
+class DS2ChannelTable {
+	public:
+		DS2ChannelTable(const DS2Channel channels[], uint8_t count);
+		
+		// Decode all channels from frame, values has to have room for getCount() items; returns channels decoded
+		uint8_t decode(const DS2Frame &frame, int32_t values[]) const;
+		uint8_t decode(const DS2Frame &frame, float values[]) const;
+		
+		int32_t getRaw(const DS2Frame &frame, uint8_t index) const;
+		int32_t getValue(const DS2Frame &frame, uint8_t index) const; // fixed point value of one channel
+		// Reads 1-4 byte value at payload offset with DS2_CHANNEL_* flags
+		static int32_t readRaw(const DS2Frame &frame, uint8_t offset, uint8_t width, uint8_t flags);
+		uint8_t find(const char *name) const; // index of channel or 255
+		const DS2Channel &getChannel(uint8_t index) const { return channels[index]; }
+		uint8_t getCount() const { return count; }
+		
+	private:
+		const DS2Channel *channels;
+		uint8_t count;
+		uint16_t needed = 0; // payload length that holds every channel, decode skips per channel bounds check then
+};
+
+#endif /* DS2Channel_h */
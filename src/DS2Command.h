@@ -0,0 +1,94 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Command
+*	Commands built at compile time - length byte and XOR checksum are filled in by compiler:
+		DS2Command<5> generalValues = ds2Command<0x12, 0x0B, 0x03>();		// {0x12, 0x05, 0x0B, 0x03, 0x1F}
+		DS2Command<6> kwpId = kwpCommand<0x12, 0xF1, 0x1A, 0x80>();			// {0x80, 0x12, 0xF1, 0x02, 0x1A, 0x80, 0xFB}
+	Bytes are template arguments, so value out of 0-255 range, empty command or frame over 255 bytes fails to compile.
+	Command converts to uint8_t * and can be passed anywhere DS2 takes command array; it is constant initialized,
+	nothing runs at startup.
+
+*	Hand written arrays can be checked at compile time too if they are constexpr:
+		constexpr uint8_t ecuId[] = {0x12, 0x04, 0x00, 0x16};
+		static_assert(ds2CommandValid<DS2Protocol>(ecuId, sizeof(ecuId)), "bad ecuId");
+**/
+
+#ifndef DS2Command_h
+#define DS2Command_h
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+  #include "pins_arduino.h"
+  #include "WConstants.h"
+#endif
+
+#include "DS2Protocol.h"
+
+// Format byte of KWP commands built by kwpCommand - physical addressing, length in separate byte
+#ifndef KWP_FORMAT
+#define KWP_FORMAT 0x80
+#endif
+
+
+// Plain array so it works on AVR without std::array
+template<uint8_t N>
+struct DS2Command {
+	uint8_t data[N];
+	
+	constexpr uint8_t size() const { return N; }
+	operator uint8_t *() { return data; }
+	constexpr operator const uint8_t *() const { return data; }
+};
+
+// XOR of all bytes
+constexpr uint8_t ds2Xor() { return 0; }
+template<class... Bytes>
+constexpr uint8_t ds2Xor(uint8_t first, Bytes... rest) { return first ^ ds2Xor(rest...); }
+
+// XOR of first length bytes of array
+constexpr uint8_t ds2XorOf(const uint8_t data[], uint8_t length) {
+	return length ? data[length - 1] ^ ds2XorOf(data, length - 1) : 0;
+}
+
+// DS2 - device, length, payload (command byte first), checksum
+template<uint8_t Device, uint8_t... Payload>
+constexpr DS2Command<sizeof...(Payload) + 3> ds2Command() {
+	static_assert(sizeof...(Payload) != 0, "DS2 command needs at least command byte");
+	static_assert(sizeof...(Payload) + 3 <= 255, "DS2 frame longer than 255 bytes");
+	return DS2Command<sizeof...(Payload) + 3> {{Device, (uint8_t) (sizeof...(Payload) + 3), Payload...,
+			ds2Xor(Device, (uint8_t) (sizeof...(Payload) + 3), Payload...)}};
+}
+
+// KWP - format, target, source, payload length, payload (service id first), checksum
+template<uint8_t Target, uint8_t Source, uint8_t... Payload>
+constexpr DS2Command<sizeof...(Payload) + 5> kwpCommand() {
+	static_assert(sizeof...(Payload) != 0, "KWP command needs at least service id");
+	static_assert(sizeof...(Payload) + 5 <= 255, "KWP frame longer than 255 bytes");
+	return DS2Command<sizeof...(Payload) + 5> {{KWP_FORMAT, Target, Source, (uint8_t) sizeof...(Payload), Payload...,
+			ds2Xor(KWP_FORMAT, Target, Source, (uint8_t) sizeof...(Payload), Payload...)}};
+}
+
+// Length byte matches size and checksum is right
+template<class Protocol>
+constexpr bool ds2CommandValid(const uint8_t command[], uint8_t size) {
+	return size >= Protocol::minLength() && Protocol::frameLength(command) == size && ds2XorOf(command, size) == 0;
+}
+
+#endif /* DS2Command_h */
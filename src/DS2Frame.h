@@ -0,0 +1,134 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Frame
+*	Read only view of one received response. Header, payload, ack status and timestamp are resolved once when
+*	frame is complete so it doesn't depend on DS2 state anymore - you can keep it, pass it to another task and decode
+*	later while next request is already on the bus. Nothing is copied, so buffer must stay untouched while view is used.
+
+*	Payload starts after header (DS2 - device, length, ack; KWP - format, target, source, length) and ends before checksum.
+	Offsets are same as in DS2::getByte & co. Reading outside payload returns 0 instead of random memory.
+**/
+
+#ifndef DS2Frame_h
+#define DS2Frame_h
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+  #include "pins_arduino.h"
+  #include "WConstants.h"
+#endif
+
+#include "DS2Protocol.h"
+
+// Memory barrier between filling shared data and publishing it, reader can run on other core
+#if defined(ESP32) || defined(DS2_HOST)
+	#define DS2_BARRIER() __sync_synchronize()
+#else
+	#define DS2_BARRIER() __asm__ __volatile__("" ::: "memory")
+#endif
+
+
+class DS2Frame {
+	public:
+		DS2Frame() {}
+		// data points to response (echo already skipped); ok is result of ack check
+		DS2Frame(const uint8_t data[], bool kwp, bool ok, uint32_t timeStamp):frame(data), timeStamp(timeStamp), ok(ok), kwp(kwp) {
+			frameLength = kwp ? KWPProtocol::frameLength(data) : DS2Protocol::frameLength(data);
+			uint8_t header = kwp ? KWPProtocol::header() : DS2Protocol::header();
+			if(frameLength > header) {
+				payload = data + header;
+				payloadLength = frameLength - header - 1;
+			}
+		}
+		
+		bool isValid() const { return frameLength != 0; }
+		bool isOk() const { return ok; } // response acknowledged
+		bool isKwp() const { return kwp; }
+		uint32_t getTimeStamp() const { return timeStamp; } // micros() when last byte was read
+		
+		uint8_t getDevice() const { return frameLength ? frame[kwp ? KWPProtocol::senderIndex() : DS2Protocol::senderIndex()] : 0; } // sender of response
+		uint8_t getAck() const { return frameLength ? frame[kwp ? KWPProtocol::ackIndex() : DS2Protocol::ackIndex()] : 0; }
+		const uint8_t *getData() const { return frame; }
+		uint8_t getLength() const { return frameLength; } // whole response with header and checksum
+		const uint8_t *getPayload() const { return payload; }
+		uint8_t getPayloadLength() const { return payloadLength; }
+		
+		// Out of range index is turned into 0 and result masked out, so no branch on hot path. Offset is wider than
+		//	payload length so offset + n from getInt/getUint64 doesn't wrap back into payload
+		uint8_t getByte(uint16_t offset) const {
+			uint8_t inside = offset < payloadLength;
+			return payload[offset * inside] & (uint8_t) -inside;
+		}
+		uint16_t getInt(uint8_t offset) const {
+			return (uint16_t) getByte(offset) << 8 | getByte((uint16_t) offset + 1);
+		}
+		uint64_t getUint64(uint8_t offset, bool reverseEndianess = false, uint8_t length = 8) const {
+			uint64_t result = 0;
+			if(length > 8) length = 8;
+			for(uint8_t i = 0; i < length; i++) {
+				uint64_t value = getByte((uint16_t) offset + i);
+				result |= value << (8 * (reverseEndianess ? i : length - 1 - i));
+			}
+			return result;
+		}
+		uint8_t getString(char string[], uint8_t offset, uint8_t length = 255) const {
+			length = clampLength(offset, length);
+			uint8_t i = 0;
+			for(; i < length && payload[offset + i] != 0; i++) string[i] = (char) payload[offset + i];
+			string[i] = 0;
+			return i;
+		}
+		uint8_t getArray(uint8_t array[], uint8_t offset, uint8_t length = 255) const {
+			length = clampLength(offset, length);
+			memcpy(array, payload + offset, length);
+			return length;
+		}
+		
+	private:
+		const uint8_t *frame = nullptr;
+		const uint8_t *payload = (const uint8_t *) ""; // empty frame still has one readable 0 byte
+		uint32_t timeStamp = 0;
+		uint8_t frameLength = 0, payloadLength = 0;
+		bool ok = false, kwp = false;
+		
+		uint8_t clampLength(uint8_t offset, uint8_t length) const {
+			if(offset >= payloadLength) return 0;
+			return length < payloadLength - offset ? length : payloadLength - offset;
+		}
+};
+
+// Whole command length from its length byte
+inline uint8_t ds2CommandLength(const uint8_t command[], bool kwp) {
+	return kwp ? KWPProtocol::frameLength(command) : DS2Protocol::frameLength(command);
+}
+
+// 16 bit FNV-1a of command bytes, never 0 so 0 can mark empty slot
+inline uint16_t ds2CommandHash(const uint8_t command[], bool kwp) {
+	uint32_t hash = 2166136261UL;
+	uint8_t length = ds2CommandLength(command, kwp);
+	for(uint8_t i = 0; i < length; i++) {
+		hash ^= command[i];
+		hash *= 16777619UL;
+	}
+	hash = (hash >> 16) ^ (hash & 0xFFFF);
+	return hash ? hash : 1;
+}
+
+#endif /* DS2Frame_h */
@@ -0,0 +1,63 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DS2LengthCache.h"
+
+
+void DS2LengthCache::learn(uint16_t hash, uint8_t length, uint32_t turnaroundUs) {
+	DS2LengthEntry &entry = slot(hash);
+	if(entry.hash != hash || entry.length != length) {
+		entry.hash = hash;
+		entry.length = length;
+		entry.samples = 0;
+	}
+	if(entry.samples == 0) {
+		entry.turnaround = turnaroundUs;
+		entry.deviation = turnaroundUs / 2;
+	} else {
+		uint32_t error = turnaroundUs > entry.turnaround ? turnaroundUs - entry.turnaround : entry.turnaround - turnaroundUs;
+		entry.deviation = entry.deviation - (entry.deviation >> 2) + (error >> 2);
+		entry.turnaround = entry.turnaround - (entry.turnaround >> 3) + (turnaroundUs >> 3);
+	}
+	if(entry.samples < 255) entry.samples++;
+	entry.backoff = false;
+}
+
+void DS2LengthCache::miss(uint16_t hash) {
+	DS2LengthEntry &entry = slot(hash);
+	if(entry.hash == hash) entry.backoff = true;
+}
+
+const DS2LengthEntry *DS2LengthCache::find(uint16_t hash) const {
+	const DS2LengthEntry &entry = entries[hash & (DS2_LENGTH_CACHE - 1)];
+	return entry.hash == hash && hash != 0 ? &entry : nullptr;
+}
+
+uint8_t DS2LengthCache::getLength(uint16_t hash) const {
+	const DS2LengthEntry *entry = find(hash);
+	return entry ? entry->length : 0;
+}
+
+uint32_t DS2LengthCache::getDeadline(uint16_t hash, uint32_t timeoutMs) const {
+	const DS2LengthEntry *entry = find(hash);
+	if(entry == nullptr || entry->backoff || entry->samples < DS2_LENGTH_SAMPLES) return timeoutMs;
+	uint32_t deadline = (entry->turnaround + 4 * entry->deviation + 999) / 1000 + DS2_LENGTH_MARGIN;
+	return deadline < timeoutMs ? deadline : timeoutMs;
+}
+
+void DS2LengthCache::clear() {
+	memset(entries, 0, sizeof(entries));
+}
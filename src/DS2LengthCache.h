@@ -0,0 +1,81 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2LengthCache
+*	Remembers response length and turnaround of each command, so DS2 doesn't depend on last request's
+*	responseLength when commands alternate, and a missing response is given up after learned deadline instead
+*	of full ISO_TIMEOUT.
+
+*	Direct mapped on hash of command bytes (DS2_LENGTH_CACHE entries, power of 2), colliding command just
+	takes the entry over and learns again.
+*	Turnaround is smoothed like TCP round trip time - average plus 4 times mean deviation, plus DS2_LENGTH_MARGIN
+	for loop/task jitter. Deadline is used only after few samples and goes back to full timeout after a timeout,
+	so slow ECU moment costs one long wait, not repeated false timeouts.
+**/
+
+#ifndef DS2LengthCache_h
+#define DS2LengthCache_h
+
+#include "DS2Frame.h"
+
+#ifndef DS2_LENGTH_CACHE
+#define DS2_LENGTH_CACHE 8
+#endif
+#if DS2_LENGTH_CACHE & (DS2_LENGTH_CACHE - 1)
+	#error "DS2_LENGTH_CACHE has to be power of 2"
+#endif
+
+// Extra ms on top of learned turnaround
+#ifndef DS2_LENGTH_MARGIN
+#define DS2_LENGTH_MARGIN 10
+#endif
+
+// Responses needed before deadline is trusted
+#define DS2_LENGTH_SAMPLES 3
+
+
+struct DS2LengthEntry {
+	uint16_t hash; // 0 - empty
+	uint8_t length; // bytes stored for response (with echo unless stripped)
+	uint8_t samples;
+	uint32_t turnaround; // us from write to complete response, smoothed
+	uint32_t deviation; // us, smoothed mean deviation
+	bool backoff; // last one timed out, use full timeout
+};
+
+
+class DS2LengthCache {
+	public:
+		DS2LengthCache() { clear(); }
+		
+		void learn(uint16_t hash, uint8_t length, uint32_t turnaroundUs);
+		void miss(uint16_t hash); // command timed out
+		uint8_t getLength(uint16_t hash) const; // 0 if not known
+		uint32_t getDeadline(uint16_t hash, uint32_t timeoutMs) const; // ms, never above timeoutMs
+		const DS2LengthEntry *find(uint16_t hash) const;
+		void clear();
+		// Whole table, for saving learned state and putting it back after reboot
+		const DS2LengthEntry &getEntry(uint8_t index) const { return entries[index]; }
+		void restore(const DS2LengthEntry &entry) { if(entry.hash != 0) slot(entry.hash) = entry; }
+		
+	private:
+		DS2LengthEntry entries[DS2_LENGTH_CACHE];
+		
+		DS2LengthEntry &slot(uint16_t hash) { return entries[hash & (DS2_LENGTH_CACHE - 1)]; }
+};
+
+#endif /* DS2LengthCache_h */
@@ -0,0 +1,260 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2LogCodec.h>
+
+
+static uint8_t putVarint(uint8_t out[], uint32_t value) {
+	uint8_t length = 0;
+	while(value >= 0x80) {
+		out[length++] = (uint8_t) value | 0x80;
+		value >>= 7;
+	}
+	out[length++] = (uint8_t) value;
+	return length;
+}
+
+// Returns false if data ended before last byte, broken is set when varint is longer than 5 bytes
+static bool getVarint(const uint8_t data[], uint32_t length, uint32_t &position, uint32_t &value, bool &broken) {
+	value = 0;
+	for(uint8_t shift = 0; shift < 35; shift += 7) {
+		if(position >= length) return false;
+		uint8_t byte = data[position++];
+		value |= (uint32_t) (byte & 0x7F) << shift;
+		if(!(byte & 0x80)) return true;
+	}
+	broken = true;
+	return true;
+}
+
+static uint32_t zigzag(int32_t value) {
+	return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+	return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static uint8_t keyframeCheck(const uint8_t timeStamp[]) {
+	return timeStamp[0] ^ timeStamp[1] ^ timeStamp[2] ^ timeStamp[3] ^ 0xA5;
+}
+
+static bool isKeyframe(const uint8_t data[]) {
+	return data[0] == DS2_PACK_SYNC && data[1] == 'K' && data[6] == keyframeCheck(data + 2);
+}
+
+
+uint16_t DS2LogEncoder::writeKeyframe(uint32_t timeStamp, uint8_t out[]) {
+	out[0] = DS2_PACK_SYNC;
+	out[1] = 'K';
+	out[2] = (uint8_t) timeStamp;
+	out[3] = (uint8_t) (timeStamp >> 8);
+	out[4] = (uint8_t) (timeStamp >> 16);
+	out[5] = (uint8_t) (timeStamp >> 24);
+	out[6] = keyframeCheck(out + 2);
+	started = true;
+	used = 0;
+	keyframeAt = lastAt = timeStamp;
+	keyframes++;
+	return DS2_PACK_KEYFRAME_LENGTH;
+}
+
+uint16_t DS2LogEncoder::encode(uint8_t command, const uint8_t payload[], uint8_t length, uint32_t timeStamp, uint8_t out[]) {
+	uint16_t size = 0;
+	if(!started || (keyframeInterval != 0 && timeStamp - keyframeAt >= keyframeInterval)) size = writeKeyframe(timeStamp, out);
+	uint32_t delta = timeStamp - lastAt;
+	lastAt = timeStamp;
+	records++;
+	inputBytes += DS2_LOG_HEADER + length;
+	
+	uint8_t slot = 0;
+	while(slot < used && references[slot].command != command) slot++;
+	Reference *reference = slot < used ? &references[slot] : nullptr;
+	
+	if(reference != nullptr && reference->length == length) {
+		out[size++] = DS2_PACK_XOR + slot;
+		size += putVarint(out + size, zigzag((int32_t) (delta - reference->delta)));
+		reference->delta = delta;
+		
+		// Reference becomes new payload; trailing zeros are not stored
+		uint8_t diffs[DS2_PACK_PAYLOAD];
+		uint8_t covered = 0;
+		for(uint8_t i = 0; i < length; i++) {
+			diffs[i] = reference->payload[i] ^ payload[i];
+			reference->payload[i] = payload[i];
+			if(diffs[i]) covered = i + 1;
+		}
+		out[size++] = covered;
+		uint8_t i = 0;
+		while(i < covered) {
+			uint8_t start = i;
+			if(diffs[i] == 0 && diffs[i + 1] == 0) {
+				while(i < covered && diffs[i] == 0 && i - start < 128) i++;
+				out[size++] = i - start - 1;
+			} else {
+				// Single zero between changes costs less as changed byte than as its own run
+				while(i < covered && i - start < 128 && !(diffs[i] == 0 && (i + 1 >= covered || diffs[i + 1] == 0))) i++;
+				out[size++] = 0x80 | (i - start - 1);
+				memcpy(out + size, diffs + start, i - start);
+				size += i - start;
+			}
+		}
+	} else {
+		bool keep = reference != nullptr || used < DS2_PACK_STREAMS;
+#if DS2_PACK_PAYLOAD < 255
+		if(length > DS2_PACK_PAYLOAD) keep = false;
+#endif
+		out[size++] = keep ? DS2_PACK_REFERENCE : DS2_PACK_RAW;
+		out[size++] = command;
+		size += putVarint(out + size, delta);
+		out[size++] = length;
+		memcpy(out + size, payload, length);
+		size += length;
+		if(keep) {
+			if(reference == nullptr) reference = &references[used++];
+			reference->command = command;
+			reference->length = length;
+			reference->delta = delta;
+			memcpy(reference->payload, payload, length);
+		}
+	}
+	outputBytes += size;
+	return size;
+}
+
+size_t DS2LogEncoder::write(Print &out, uint8_t command, const DS2Frame &frame) {
+	uint8_t packed[DS2_PACK_RECORD_MAX];
+	return out.write(packed, encode(command, frame, packed));
+}
+
+
+bool DS2LogDecoder::seek(const uint8_t data[], uint32_t length, uint32_t &position) {
+	synced = false;
+	for(; position + DS2_PACK_KEYFRAME_LENGTH <= length; position++) {
+		if(isKeyframe(data + position)) return true;
+	}
+	return false;
+}
+
+bool DS2LogDecoder::read(const uint8_t data[], uint32_t length, uint32_t &position, DS2LogRecord &record) {
+	while(true) {
+		while(position < length && data[position] == 0) position++;
+		uint32_t start = position;
+		uint8_t result = readRecord(data, length, position, record);
+		if(result == PACK_RECORD) return true;
+		if(result == PACK_KEYFRAME) continue;
+		if(result == PACK_MORE) {
+			position = start;
+			return false;
+		}
+		// Broken - look for next keyframe after it
+		errors++;
+		position = start + 1;
+		if(!seek(data, length, position)) return false;
+	}
+}
+
+uint8_t DS2LogDecoder::readRecord(const uint8_t data[], uint32_t length, uint32_t &position, DS2LogRecord &record) {
+	if(position >= length) return PACK_MORE;
+	uint8_t tag = data[position];
+	
+	if(tag == DS2_PACK_SYNC) {
+		if(position + DS2_PACK_KEYFRAME_LENGTH > length) return PACK_MORE;
+		if(!isKeyframe(data + position)) return PACK_BROKEN;
+		const uint8_t *time = data + position + 2;
+		lastAt = (uint32_t) time[0] | (uint32_t) time[1] << 8 | (uint32_t) time[2] << 16 | (uint32_t) time[3] << 24;
+		used = 0;
+		synced = true;
+		position += DS2_PACK_KEYFRAME_LENGTH;
+		return PACK_KEYFRAME;
+	}
+	if(!synced) return PACK_BROKEN;
+	position++;
+	
+	bool broken = false;
+	uint32_t value;
+	if(tag == DS2_PACK_REFERENCE || tag == DS2_PACK_RAW) {
+		if(position >= length) return PACK_MORE;
+		uint8_t command = data[position++];
+		if(!getVarint(data, length, position, value, broken)) return PACK_MORE;
+		if(broken || position >= length) return broken ? PACK_BROKEN : PACK_MORE;
+		uint8_t payloadLength = data[position++];
+		if(position + payloadLength > length) return PACK_MORE;
+		
+		const uint8_t *payload = data + position;
+		position += payloadLength;
+		if(tag == DS2_PACK_REFERENCE) {
+			uint8_t slot = 0;
+			while(slot < used && references[slot].command != command) slot++;
+			if(slot >= DS2_PACK_STREAMS) return PACK_BROKEN; // encoder has bigger limits
+#if DS2_PACK_PAYLOAD < 255
+			if(payloadLength > DS2_PACK_PAYLOAD) return PACK_BROKEN;
+#endif
+			if(slot == used) used++;
+			Reference &reference = references[slot];
+			reference.command = command;
+			reference.length = payloadLength;
+			reference.delta = value;
+			memcpy(reference.payload, payload, payloadLength);
+			payload = reference.payload;
+		}
+		lastAt += value;
+		record.command = command;
+		record.length = payloadLength;
+		record.payload = payload;
+		record.timeStamp = lastAt;
+		return PACK_RECORD;
+	}
+	
+	if(tag < DS2_PACK_XOR || tag - DS2_PACK_XOR >= used) return PACK_BROKEN;
+	Reference &reference = references[tag - DS2_PACK_XOR];
+	if(!getVarint(data, length, position, value, broken)) return PACK_MORE;
+	if(broken) return PACK_BROKEN;
+	if(position >= length) return PACK_MORE;
+	uint8_t covered = data[position++];
+	if(covered > reference.length) return PACK_BROKEN;
+	
+	// Check whole record is there before reference is touched, so it can be read again when more data comes
+	uint32_t end = position;
+	for(uint16_t done = 0; done < covered;) {
+		if(end >= length) return PACK_MORE;
+		uint8_t run = data[end++];
+		uint8_t count = (run & 0x7F) + 1;
+		if(run & 0x80) end += count;
+		done += count;
+		if(done > covered) return PACK_BROKEN;
+	}
+	if(end > length) return PACK_MORE;
+	
+	uint8_t i = 0;
+	while(i < covered) {
+		uint8_t run = data[position++];
+		uint8_t count = (run & 0x7F) + 1;
+		if(run & 0x80) {
+			for(uint8_t j = 0; j < count; j++) reference.payload[i + j] ^= data[position + j];
+			position += count;
+		}
+		i += count;
+	}
+	reference.delta += (uint32_t) unzigzag(value);
+	lastAt += reference.delta;
+	record.command = reference.command;
+	record.length = reference.length;
+	record.payload = reference.payload;
+	record.timeStamp = lastAt;
+	return PACK_RECORD;
+}
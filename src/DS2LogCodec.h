@@ -0,0 +1,159 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2LogCodec
+*	Compact stream format for logged frames, for long sessions on SD card or over Bluetooth SPP. DS2LogEncoder is cheap
+*	enough to run inline after every response, DS2LogDecoder reads it back on PC or on device.
+
+*	Each command gets reference of its previous payload. Next payload of same length is XORed against it and
+	only changed bytes are stored - runs of zeros and runs of changed bytes, trailing zeros are left out. Timestamp
+	is stored as change of delta from previous record (zigzag varint), for steady polling that is 1 byte.
+	Keyframe every setKeyframeInterval() drops all references, so decoding can start at any keyframe (see seek).
+
+*	Stream format (little endian), zero bytes between records are padding and are skipped like in DS2Logger:
+	-	0xDC 'K' timestamp[4] check - keyframe, check is XOR of timestamp bytes and 0xA5
+	-	0xA0 command delta length payload - new reference for command, gets next free slot
+	-	0xA2 command delta length payload - raw record, no reference (payload too long or no free slot)
+	-	0x40 + slot deltaChange covered runs - XOR of payload and reference, covered is how many bytes runs cover,
+		run byte below 0x80 is n + 1 zeros, above is n + 1 changed bytes that follow
+	delta is micros from previous record (varint), deltaChange is delta minus previous delta of same slot (zigzag varint).
+
+*	Decoder needs at least as many slots and as long references as encoder (same DS2_PACK_* or bigger).
+
+*	Usage:
+	DS2LogEncoder packer;
+	uint8_t packed[DS2_PACK_RECORD_MAX];
+	if(DS2.receiveData(data) == RECEIVE_OK) {
+		// encode() already took record as reference, if it's not stored next one must start with keyframe
+		if(!logger.write(packed, packer.encode(0, DS2.getFrame(), packed))) packer.reset();
+	}
+	
+	DS2LogDecoder unpacker;
+	DS2LogRecord record;
+	uint32_t position = 0;
+	while(unpacker.read(file, fileLength, position, record)) print(record);
+**/
+
+#ifndef DS2LogCodec_h
+#define DS2LogCodec_h
+
+#include "DS2Logger.h"
+
+// Commands that get their own reference, up to 64
+#ifndef DS2_PACK_STREAMS
+	#if defined(__AVR__)
+		#define DS2_PACK_STREAMS 2
+	#else
+		#define DS2_PACK_STREAMS 8
+	#endif
+#endif
+#if DS2_PACK_STREAMS > 64
+	#error "DS2_PACK_STREAMS can't be over 64"
+#endif
+
+// Longest payload kept as reference, longer ones are stored raw
+#ifndef DS2_PACK_PAYLOAD
+	#if defined(__AVR__)
+		#define DS2_PACK_PAYLOAD 32
+	#else
+		#define DS2_PACK_PAYLOAD 255
+	#endif
+#endif
+
+// Default keyframe interval in micros
+#ifndef DS2_PACK_KEYFRAME
+#define DS2_PACK_KEYFRAME 2000000UL
+#endif
+
+#define DS2_PACK_SYNC 0xDC
+#define DS2_PACK_REFERENCE 0xA0
+#define DS2_PACK_RAW 0xA2
+#define DS2_PACK_XOR 0x40
+#define DS2_PACK_KEYFRAME_LENGTH 7
+// Longest encoded record, keyframe included - buffer size for encode
+#define DS2_PACK_RECORD_MAX (DS2_PACK_KEYFRAME_LENGTH + 8 + 255 + 2)
+
+
+class DS2LogEncoder {
+	public:
+		DS2LogEncoder() {}
+		
+		// Encodes record into out, which needs room for DS2_PACK_RECORD_MAX bytes; returns bytes written
+		uint16_t encode(uint8_t command, const DS2Frame &frame, uint8_t out[]) { return encode(command, frame.getPayload(), frame.getPayloadLength(), frame.getTimeStamp(), out); }
+		uint16_t encode(uint8_t command, const uint8_t payload[], uint8_t length, uint32_t timeStamp, uint8_t out[]);
+		// Same but written to out in one call, i.e. BluetoothSerial or File
+		size_t write(Print &out, uint8_t command, const DS2Frame &frame);
+		
+		// Micros between keyframes, 0 - only first one; decoding can start only at keyframe
+		void setKeyframeInterval(uint32_t intervalUs) { keyframeInterval = intervalUs; }
+		void reset() { started = false; } // next record starts with keyframe, i.e. for new file or after encoded record was lost
+		
+		uint32_t getRecords() { return records; }
+		uint32_t getKeyframes() { return keyframes; }
+		uint32_t getInputBytes() { return inputBytes; } // what DS2Logger records would take
+		uint32_t getOutputBytes() { return outputBytes; }
+		
+	private:
+		struct Reference {
+			uint8_t command;
+			uint8_t length;
+			uint32_t delta;
+			uint8_t payload[DS2_PACK_PAYLOAD];
+		};
+		Reference references[DS2_PACK_STREAMS];
+		uint8_t used = 0;
+		bool started = false;
+		uint32_t keyframeInterval = DS2_PACK_KEYFRAME;
+		uint32_t keyframeAt = 0, lastAt = 0;
+		uint32_t records = 0, keyframes = 0, inputBytes = 0, outputBytes = 0;
+		
+		uint16_t writeKeyframe(uint32_t timeStamp, uint8_t out[]);
+};
+
+
+class DS2LogDecoder {
+	public:
+		DS2LogDecoder() {}
+		
+		// Reads next record from encoded data at position and moves position past it. Payload stays valid until next
+		//	read. Returns false at end of data or when last record is not complete yet - position is left at its start,
+		//	so it can be called again when more data arrived. Broken data is skipped to next keyframe and counted
+		bool read(const uint8_t data[], uint32_t length, uint32_t &position, DS2LogRecord &record);
+		// Moves position to first keyframe at or after it, next read starts there; returns false if there is none
+		bool seek(const uint8_t data[], uint32_t length, uint32_t &position);
+		void reset() { synced = false; }
+		
+		uint32_t getErrors() { return errors; } // times data was broken and skipped
+		
+	private:
+		struct Reference {
+			uint8_t command;
+			uint8_t length;
+			uint32_t delta;
+			uint8_t payload[DS2_PACK_PAYLOAD];
+		};
+		Reference references[DS2_PACK_STREAMS];
+		uint8_t used = 0;
+		bool synced = false;
+		uint32_t lastAt = 0;
+		uint32_t errors = 0;
+		
+		enum { PACK_MORE, PACK_RECORD, PACK_KEYFRAME, PACK_BROKEN };
+		uint8_t readRecord(const uint8_t data[], uint32_t length, uint32_t &position, DS2LogRecord &record);
+};
+
+#endif /* DS2LogCodec_h */
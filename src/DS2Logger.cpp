@@ -0,0 +1,167 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Logger.h>
+
+
+bool DS2Logger::begin(Print &output, bool useTask) {
+	if(size == 0) return false;
+	end();
+	out = &output;
+	head = tail = 0;
+	full = false;
+	running = true;
+#if defined(ESP32)
+	if(useTask) {
+		taskDone = false;
+		// Core 0 - Arduino loop runs on core 1
+		if(xTaskCreatePinnedToCore(writerTask, "DS2Logger", 4096, this, 1, &task, 0) != pdPASS) {
+			task = nullptr;
+			taskDone = true;
+		}
+	}
+#else
+	(void) useTask;
+#endif
+	return true;
+}
+
+void DS2Logger::end() {
+	if(!running) return;
+	running = false;
+#if defined(ESP32)
+	while(!taskDone) delay(1);
+	task = nullptr;
+#endif
+	service();
+	
+	// Full block still waiting means output failed in service(), what's left can't be written
+	uint32_t used = head - tail;
+	if(used >= DS2_LOG_BLOCK) {
+		lost += used;
+		tail = head;
+		used = 0;
+	}
+	// Last partial block padded with zeros so file stays sector aligned
+	if(used > 0) {
+		uint8_t block[DS2_LOG_BLOCK];
+		memset(block, 0, sizeof(block));
+		for(uint32_t i = 0; i < used; i++) block[i] = buffer[(tail + i) % size];
+		writeBlock(block, DS2_LOG_BLOCK);
+		tail = head;
+	}
+	out->flush();
+}
+
+void DS2Logger::put(uint32_t position, const uint8_t bytes[], uint16_t length) {
+	uint32_t index = position % size;
+	uint32_t first = size - index;
+	if(first > length) first = length;
+	memcpy(buffer + index, bytes, first);
+	memcpy(buffer, bytes + first, length - first);
+}
+
+bool DS2Logger::fits(uint32_t length) {
+	if(!running) return false;
+	if(head - tail + length > size) {
+		if(!full) overflows++;
+		full = true;
+		dropped++;
+		return false;
+	}
+	full = false;
+	return true;
+}
+
+void DS2Logger::publish(uint32_t position, uint32_t length) {
+	DS2_BARRIER();
+	head = position + length;
+	records++;
+	if(head - tail > highWater) highWater = head - tail;
+}
+
+bool DS2Logger::log(uint8_t command, const uint8_t payload[], uint8_t length, uint32_t timeStamp) {
+	uint32_t recordLength = DS2_LOG_HEADER + length;
+	if(!fits(recordLength)) return false;
+	uint8_t header[DS2_LOG_HEADER] = {DS2_LOG_SYNC, command, length,
+			(uint8_t) timeStamp, (uint8_t) (timeStamp >> 8), (uint8_t) (timeStamp >> 16), (uint8_t) (timeStamp >> 24)};
+	uint32_t position = head;
+	put(position, header, DS2_LOG_HEADER);
+	put(position + DS2_LOG_HEADER, payload, length);
+	publish(position, recordLength);
+	return true;
+}
+
+bool DS2Logger::write(const uint8_t bytes[], uint16_t length) {
+	if(length == 0 || !fits(length)) return false;
+	uint32_t position = head;
+	put(position, bytes, length);
+	publish(position, length);
+	return true;
+}
+
+uint16_t DS2Logger::service() {
+	if(out == nullptr) return 0;
+	uint16_t blocks = 0;
+	// size is multiple of block and tail only moves by blocks, so block never wraps
+	while(head - tail >= DS2_LOG_BLOCK) {
+		DS2_BARRIER();
+		if(!writeBlock(buffer + tail % size, DS2_LOG_BLOCK)) break;
+		DS2_BARRIER();
+		tail += DS2_LOG_BLOCK;
+		blocks++;
+	}
+	return blocks;
+}
+
+bool DS2Logger::writeBlock(const uint8_t block[], uint16_t length) {
+	uint32_t start = micros();
+	size_t written = out->write(block, length);
+	uint32_t time = micros() - start;
+	if(time > maxWriteTime) maxWriteTime = time;
+	bytesWritten += written;
+	return written == length;
+}
+
+void DS2Logger::resetCounters() {
+	records = dropped = overflows = bytesWritten = maxWriteTime = lost = 0;
+	highWater = head - tail;
+}
+
+bool DS2Logger::parse(const uint8_t data[], uint32_t length, uint32_t &position, DS2LogRecord &record) {
+	while(position < length && data[position] == 0) position++;
+	if(position + DS2_LOG_HEADER > length || data[position] != DS2_LOG_SYNC) return false;
+	const uint8_t *header = data + position;
+	if(position + DS2_LOG_HEADER + header[2] > length) return false;
+	record.command = header[1];
+	record.length = header[2];
+	record.timeStamp = (uint32_t) header[3] | (uint32_t) header[4] << 8 | (uint32_t) header[5] << 16 | (uint32_t) header[6] << 24;
+	record.payload = header + DS2_LOG_HEADER;
+	position += DS2_LOG_HEADER + record.length;
+	return true;
+}
+
+#if defined(ESP32)
+void DS2Logger::writerTask(void *parameter) {
+	DS2Logger *logger = (DS2Logger *) parameter;
+	while(logger->running) {
+		if(logger->service() == 0) vTaskDelay(1);
+	}
+	logger->taskDone = true;
+	vTaskDelete(NULL);
+}
+#endif
@@ -0,0 +1,129 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Logger
+*	Binary logger that never waits for SD card. log() copies record into preallocated RAM ring buffer and returns,
+*	writer drains it to file in whole 512 byte blocks (one SD sector) - from FreeRTOS task on ESP32 or from service() in loop.
+*	If card stalls and ring fills up records are dropped and counted, poll rate doesn't change.
+
+*	Record format (little endian):
+	-	0xD5 - sync byte
+	-	command id - whatever you want to tag the record with (i.e. scheduler index)
+	-	length - payload length
+	-	timestamp - 4 bytes, micros()
+	-	payload
+	Zero bytes between records are padding and should be skipped by reader (see DS2Logger::parse).
+
+*	Usage:
+	uint8_t logBuffer[8192]; // multiple of 512
+	DS2Logger logger(logBuffer, sizeof(logBuffer));
+	File file = SD.open("/log.bin", FILE_WRITE);
+	logger.preallocate(file, 1024UL * 1024); // optional, keeps FAT updates out of logging
+	logger.begin(file);
+	...
+	if(DS2.receiveData(data) == RECEIVE_OK) logger.log(0, DS2.getFrame());
+	...
+	logger.end();
+	file.close();
+**/
+
+#ifndef DS2Logger_h
+#define DS2Logger_h
+
+#include "DS2Frame.h"
+
+#define DS2_LOG_BLOCK 512
+#define DS2_LOG_SYNC 0xD5
+#define DS2_LOG_HEADER 7
+
+
+struct DS2LogRecord {
+	uint32_t timeStamp;
+	uint8_t command;
+	uint8_t length;
+	const uint8_t *payload;
+};
+
+
+class DS2Logger {
+	public:
+		// size should be multiple of 512, anything above is not used
+		DS2Logger(uint8_t buffer[], uint32_t size):buffer(buffer), size(size - size % DS2_LOG_BLOCK) {}
+		
+		// Starts logging to out; on ESP32 drains from background task unless task is false
+		bool begin(Print &out, bool task = true);
+		// Writes what's left padded to full block, stops task; if output failed, what's left is counted in getLost()
+		void end();
+		
+		// Producer side, single caller (loop or DS2 task). Returns false if record was dropped
+		bool log(uint8_t command, const DS2Frame &frame) { return log(command, frame.getPayload(), frame.getPayloadLength(), frame.getTimeStamp()); }
+		bool log(uint8_t command, const uint8_t payload[], uint8_t length, uint32_t timeStamp);
+		// Appends bytes as they are without record header, i.e. DS2LogEncoder output - counted as one record
+		bool write(const uint8_t bytes[], uint16_t length);
+		
+		// Writer side - writes all complete blocks, call in loop if there is no task. Returns blocks written
+		uint16_t service();
+		
+		// Writes zeros to file and rewinds, so logging overwrites already allocated clusters
+		template <class FileType> bool preallocate(FileType &file, uint32_t bytes) {
+			uint8_t zero[64];
+			memset(zero, 0, sizeof(zero));
+			for(uint32_t done = 0; done < bytes; done += sizeof(zero)) {
+				if(file.write(zero, sizeof(zero)) != sizeof(zero)) return false;
+			}
+			file.flush();
+			return file.seek(0);
+		}
+		
+		// Counters
+		uint32_t getRecords() { return records; }
+		uint32_t getDropped() { return dropped; } // records lost because ring was full
+		uint32_t getOverflows() { return overflows; } // times ring went full
+		uint32_t getBytesWritten() { return bytesWritten; }
+		uint32_t getLost() { return lost; } // bytes end() threw away because output stopped taking blocks
+		uint32_t getUsed() { return head - tail; }
+		uint32_t getHighWater() { return highWater; } // most bytes waiting at once
+		uint32_t getMaxWriteTime() { return maxWriteTime; } // slowest block write in us
+		void resetCounters();
+		
+		// Reads record at position from log file contents, skips padding; returns false at end
+		static bool parse(const uint8_t data[], uint32_t length, uint32_t &position, DS2LogRecord &record);
+		
+	private:
+		uint8_t *buffer;
+		uint32_t size;
+		Print *out = nullptr;
+		volatile uint32_t head = 0, tail = 0; // free running, index is value % size
+		volatile bool running = false;
+		bool full = false;
+		
+		volatile uint32_t records = 0, dropped = 0, overflows = 0, bytesWritten = 0, highWater = 0, maxWriteTime = 0;
+		uint32_t lost = 0;
+		
+#if defined(ESP32)
+		TaskHandle_t task = nullptr;
+		volatile bool taskDone = true;
+		static void writerTask(void *logger);
+#endif
+		
+		void put(uint32_t position, const uint8_t bytes[], uint16_t length);
+		bool fits(uint32_t length); // counts drop if not
+		void publish(uint32_t position, uint32_t length);
+		bool writeBlock(const uint8_t block[], uint16_t length);
+};
+
+#endif /* DS2Logger_h */
@@ -0,0 +1,124 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2MemoryMap.h>
+
+
+uint8_t DS2MemoryMap::add(uint32_t address, uint8_t width, uint8_t flags) {
+	if(channelCount >= DS2_MEMORY_CHANNELS || width == 0 || width > 4) return DS2_MEMORY_NONE;
+	DS2MemoryChannel &channel = channels[channelCount];
+	channel.address = address;
+	channel.width = width;
+	channel.flags = flags;
+	channel.request = DS2_MEMORY_NONE;
+	channel.offset = 0;
+	requestCount = 0;
+	return channelCount++;
+}
+
+void DS2MemoryMap::clear() {
+	channelCount = requestCount = 0;
+}
+
+bool DS2MemoryMap::setReadCommand(const uint8_t commandPrefix[], uint8_t length, uint8_t addressSize, bool count) {
+	if(length > sizeof(prefix) || addressSize == 0 || addressSize > 4) return false;
+	memcpy(prefix, commandPrefix, length);
+	prefixLength = length;
+	addressBytes = addressSize;
+	countByte = count;
+	return true;
+}
+
+uint8_t DS2MemoryMap::build(uint8_t maxSpan, uint8_t overhead) {
+	requestCount = 0;
+	if(channelCount == 0) return 0;
+	if(maxSpan > DS2_MEMORY_SPAN) maxSpan = DS2_MEMORY_SPAN; // response must still fit its length byte
+	// Value split between two requests would mix bytes read at different times, so it has to fit in one
+	for(uint8_t i = 0; i < channelCount; i++) {
+		if(channels[i].width > maxSpan) return 0;
+	}
+	
+	// Sort by address, insertion sort is fine for few dozen items
+	uint8_t order[DS2_MEMORY_CHANNELS];
+	for(uint8_t i = 0; i < channelCount; i++) {
+		uint8_t j = i;
+		for(; j > 0 && channels[order[j - 1]].address > channels[i].address; j--) order[j] = order[j - 1];
+		order[j] = i;
+	}
+	
+	// Greedy merge - extend current request while span fits and gap costs less than new request
+	uint32_t start = 0, end = 0;
+	for(uint8_t i = 0; i < channelCount; i++) {
+		DS2MemoryChannel &channel = channels[order[i]];
+		uint32_t channelEnd = channel.address + channel.width;
+		if(requestCount > 0) {
+			uint32_t newEnd = channelEnd > end ? channelEnd : end;
+			uint32_t gap = channel.address > end ? channel.address - end : 0;
+			if(newEnd - start <= maxSpan && gap <= overhead) {
+				end = newEnd;
+				requests[requestCount - 1].length = end - start;
+				channel.request = requestCount - 1;
+				channel.offset = channel.address - start;
+				continue;
+			}
+		}
+		if(requestCount >= DS2_MEMORY_REQUESTS) {
+			requestCount = 0;
+			return 0;
+		}
+		start = channel.address;
+		end = channelEnd;
+		requests[requestCount].address = start;
+		requests[requestCount].length = channel.width;
+		channel.request = requestCount++;
+		channel.offset = 0;
+	}
+	return requestCount;
+}
+
+uint16_t DS2MemoryMap::getReadBytes() {
+	uint16_t total = 0;
+	for(uint8_t i = 0; i < requestCount; i++) total += requests[i].length;
+	return total;
+}
+
+uint8_t DS2MemoryMap::getCommand(uint8_t request, uint8_t command[]) {
+	if(request >= requestCount) return 0;
+	uint8_t length = 0;
+	command[length++] = device;
+	command[length++] = 0;
+	for(uint8_t i = 0; i < prefixLength; i++) command[length++] = prefix[i];
+	for(uint8_t i = addressBytes; i > 0; i--) command[length++] = requests[request].address >> (8 * (i - 1));
+	if(countByte) command[length++] = requests[request].length;
+	command[1] = length + 1;
+	uint8_t checksum = 0;
+	for(uint8_t i = 0; i < length; i++) checksum ^= command[i];
+	command[length++] = checksum;
+	return length;
+}
+
+uint8_t DS2MemoryMap::scatter(uint8_t request, const DS2Frame &frame, int32_t values[]) {
+	if(!frame.isOk()) return 0; // NAK or bad frame, payload isn't memory contents
+	uint8_t filled = 0;
+	for(uint8_t i = 0; i < channelCount; i++) {
+		DS2MemoryChannel &channel = channels[i];
+		if(channel.request != request) continue;
+		values[i] = DS2ChannelTable::readRaw(frame, channel.offset, channel.width, channel.flags);
+		filled++;
+	}
+	return filled;
+}
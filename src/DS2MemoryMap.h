@@ -0,0 +1,120 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2MemoryMap
+*	Reads your own list of ECU RAM variables with as few memory read requests as possible.
+*	Register addresses and widths, build() merges neighbours into requests, then scatter() puts values from each
+*	response back into channel slots. Every request costs echo, header, checksum and ECU turnaround, so reading few
+*	unused bytes between two variables is often cheaper than sending another request - overhead tells how many
+*	bytes one extra request is worth.
+
+*	Request layout is ECU specific, default is {device, length, 0x06, address (3 bytes, MSB first), count, checksum}.
+	Use setReadCommand if your ECU wants different command or address size. Values are big endian unless
+	DS2_CHANNEL_LITTLE_ENDIAN is set (C167 based ECUs like MS4x keep words little endian in RAM).
+
+*	Usage:
+	DS2MemoryMap map;
+	map.add(0xE0F8, 2, DS2_CHANNEL_LITTLE_ENDIAN); // rpm
+	map.add(0xE0FC, 1); // ...
+	uint8_t count = map.build(32, 20);
+	uint8_t commands[DS2_MEMORY_REQUESTS][DS2_MEMORY_COMMAND];
+	for(uint8_t i = 0; i < count; i++) {
+		map.getCommand(i, commands[i]);
+		scheduler.add(commands[i], 20);
+	}
+	...
+	if(scheduler.poll(data) == RECEIVE_OK) map.scatter(scheduler.getIndex(), DS2.getFrame(), values);
+**/
+
+#ifndef DS2MemoryMap_h
+#define DS2MemoryMap_h
+
+#include "DS2Channel.h"
+
+// Max registered variables
+#ifndef DS2_MEMORY_CHANNELS
+#define DS2_MEMORY_CHANNELS 32
+#endif
+
+// Max requests after merging
+#ifndef DS2_MEMORY_REQUESTS
+#define DS2_MEMORY_REQUESTS 16
+#endif
+
+// Longest request - response is device, length, ack, data and checksum in 255 bytes
+#define DS2_MEMORY_SPAN (255 - 4)
+
+// Longest read command getCommand can build
+#define DS2_MEMORY_COMMAND 12
+
+#define DS2_MEMORY_NONE 0xFF
+
+
+struct DS2MemoryChannel {
+	uint32_t address;
+	uint8_t width; // 1 - 4 bytes
+	uint8_t flags; // DS2_CHANNEL_SIGNED, DS2_CHANNEL_LITTLE_ENDIAN
+	uint8_t request; // which request reads it, after build()
+	uint8_t offset; // offset in that request's payload
+};
+
+struct DS2MemoryRequest {
+	uint32_t address;
+	uint8_t length;
+};
+
+
+class DS2MemoryMap {
+	public:
+		DS2MemoryMap(uint8_t device = 0x12):device(device) {}
+		
+		// Returns channel index or DS2_MEMORY_NONE if full; invalidates previous build()
+		uint8_t add(uint32_t address, uint8_t width, uint8_t flags = 0);
+		void clear();
+		
+		// Command bytes that go before address, address size in bytes (1 - 4) and whether count byte follows it
+		bool setReadCommand(const uint8_t prefix[], uint8_t prefixLength, uint8_t addressBytes, bool countByte = true);
+		
+		// Merges channels into requests no longer than maxSpan bytes (at most DS2_MEMORY_SPAN), gaps up to overhead
+		//	bytes are read through. Returns number of requests, 0 if they didn't fit or some channel is wider than
+		//	maxSpan (values are never split between requests)
+		uint8_t build(uint8_t maxSpan = 32, uint8_t overhead = 20);
+		
+		uint8_t getChannelCount() { return channelCount; }
+		uint8_t getRequestCount() { return requestCount; }
+		const DS2MemoryChannel &getChannel(uint8_t index) { return channels[index]; }
+		const DS2MemoryRequest &getRequest(uint8_t index) { return requests[index]; }
+		uint16_t getReadBytes(); // total bytes read by all requests, including gaps
+		
+		// Builds complete command with length and checksum, command needs DS2_MEMORY_COMMAND bytes; returns its length
+		uint8_t getCommand(uint8_t request, uint8_t command[]);
+		// Fills values[channel] for every channel read by this request; returns how many were filled, 0 if frame isn't ok
+		uint8_t scatter(uint8_t request, const DS2Frame &frame, int32_t values[]);
+		
+	private:
+		uint8_t device;
+		uint8_t prefix[4] = {0x06};
+		uint8_t prefixLength = 1;
+		uint8_t addressBytes = 3;
+		bool countByte = true;
+		
+		DS2MemoryChannel channels[DS2_MEMORY_CHANNELS];
+		DS2MemoryRequest requests[DS2_MEMORY_REQUESTS];
+		uint8_t channelCount = 0, requestCount = 0;
+};
+
+#endif /* DS2MemoryMap_h */
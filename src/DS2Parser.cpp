@@ -0,0 +1,44 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Parser.h>
+
+
+void DS2Parser::begin(uint8_t data[], uint8_t echo, uint8_t dev, bool kwpSet, uint8_t maxLen, bool stripEcho) {
+	buffer = data;
+	echoLength = echo;
+	device = dev;
+	kwp = kwpSet;
+	maxLength = maxLen;
+	strip = stripEcho;
+	echoPhase = echo != 0;
+	position = 0;
+	index = 0;
+	frameLength = 0;
+	checksum = 0;
+	discarded = 0;
+	echoOk = false;
+	echoMatch = true;
+	sent = nullptr;
+	state = PARSE_WAITING;
+}
+
+uint8_t DS2Parser::getAck() {
+	uint8_t ackIndex = kwp ? KWPProtocol::ackIndex() : DS2Protocol::ackIndex();
+	if(echoPhase || frameLength == 0 || index <= ackIndex) return 0;
+	return buffer[position - index + ackIndex];
+}
@@ -0,0 +1,207 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Parser
+*	Byte at a time frame parser. Feed it bytes as they come and it keeps track of echo, length byte, XOR checksum and
+*	ack byte so frame is known to be complete the moment last byte lands. It has no locking - if it's fed from RX
+*	callback or ISR, nothing else may touch parser or its buffer until frame is complete.
+
+*	Frame layout it expects:
+	-	DS2 - device, length (whole frame), ack/command, payload..., checksum
+	-	KWP - format, device, source, length (payload only, frame is length + 5), payload..., checksum
+	feed() picks layout with kwp flag on every byte, feedAs<DS2Protocol>/feedAs<KWPProtocol> has it fixed at
+	compile time for code that speaks only one protocol (see DS2Protocol.h).
+
+*	Block feed takes bytes read in bulk (readBytes into staging buffer). Header still goes byte by byte, rest of frame
+	is copied with memcpy, XORed word at a time and echo compared with memcmp against command sent (expectEcho).
+	Read at most getWanted() bytes so nothing past end of frame is taken from serial.
+
+*	If echo length is set, first frame must be echo with same length; if it's not, echo is assumed to be missing
+	and bytes are treated as response (same as interfaces without echo).
+
+*	With strip set echo is only counted and XOR checked as it goes, buffer gets response alone - so it only has to be
+	as big as the response and offsets don't depend on echo. First 4 bytes of echo are kept at start of buffer
+	until length byte tells if it really is echo, then response overwrites them.
+**/
+
+#ifndef DS2Parser_h
+#define DS2Parser_h
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+  #include "pins_arduino.h"
+  #include "WConstants.h"
+#endif
+
+#include "DS2Protocol.h"
+
+// Parser states
+enum ParseState : uint8_t {
+	PARSE_IDLE,
+	PARSE_WAITING,
+	PARSE_COMPLETE,
+	PARSE_BAD
+};
+
+// Default receive flags
+enum ReceiveType : uint8_t {
+	RECEIVE_WAITING,
+	RECEIVE_TIMEOUT,
+	RECEIVE_OK,
+	RECEIVE_BAD
+};
+
+
+class DS2Parser {
+	public:
+		// Starts new frame; device != 0 makes parser skip bytes until frame starts with device (DS2 only)
+		void begin(uint8_t data[], uint8_t echo, uint8_t device, bool kwp, uint8_t maxLength = 255, bool strip = false);
+		void reset() { state = PARSE_IDLE; }
+		
+		// Feeds single byte, returns state after it
+		ParseState feed(uint8_t value) { return kwp ? feedAs<KWPProtocol>(value) : feedAs<DS2Protocol>(value); }
+		// Same with protocol known at compile time, must match kwp passed to begin()
+		template<class Protocol> ParseState feedAs(uint8_t value);
+		// Feeds block of bytes, length must not be over getWanted()
+		ParseState feed(const uint8_t data[], uint8_t length) { return kwp ? feedAs<KWPProtocol>(data, length) : feedAs<DS2Protocol>(data, length); }
+		template<class Protocol> ParseState feedAs(const uint8_t data[], uint8_t length);
+		// Echo is compared with command, must stay valid until echo is in; call after begin()
+		void expectEcho(const uint8_t command[]) { sent = command; }
+		
+		ParseState getState() { return state; }
+		uint8_t *getBuffer() { return buffer; }
+		uint8_t getLength() { return position; } // bytes stored, echo (if not stripped) + response when complete
+		uint8_t getEcho() { return echoLength; } // 0 if echo was missing
+		uint8_t getStoredEcho() { return strip ? 0 : echoLength; } // echo bytes in front of response in buffer
+		bool getEchoOk() { return echoOk; } // echo checksum was fine and echo was same as command
+		bool getEchoPhase() { return echoPhase; } // still reading echo
+		uint8_t getAck(); // ack byte of response, 0 if not there yet
+		uint8_t getRemaining() { return frameLength ? frameLength - index : 255; } // bytes until frame ends, 255 if not known yet
+		// Bytes that can be read without crossing end of frame - rest of frame, or header up to length byte
+		uint8_t getWanted() { return frameLength ? frameLength - index : (kwp ? KWPProtocol::lengthIndex() : DS2Protocol::lengthIndex()) + 1 - index; }
+		uint8_t getDiscarded() { return discarded; } // bytes skipped while looking for device
+		bool getChecksumError() { return state == PARSE_BAD && frameLength != 0; } // bad because of checksum, not length
+		
+	private:
+		uint8_t *buffer = nullptr;
+		const uint8_t *sent = nullptr;
+		volatile ParseState state = PARSE_IDLE;
+		bool kwp = false;
+		bool strip = false;
+		bool echoPhase = false;
+		bool echoOk = false;
+		bool echoMatch = true;
+		uint8_t device = 0;
+		uint8_t maxLength = 255;
+		uint8_t echoLength = 0;
+		uint8_t position = 0; // next byte in buffer
+		uint8_t index = 0; // next byte in current frame (echo or response)
+		uint8_t frameLength = 0; // 0 until length byte is known
+		uint8_t checksum = 0;
+		uint8_t discarded = 0;
+		
+		// Last byte of echo or response is in
+		ParseState endFrame() {
+			if(echoPhase) {
+				// Echo done, response starts now
+				echoPhase = false;
+				echoOk = checksum == 0 && echoMatch;
+				checksum = 0;
+				index = 0;
+				frameLength = 0;
+				if(strip) position = 0;
+				return state;
+			}
+			return (state = checksum == 0 ? PARSE_COMPLETE : PARSE_BAD);
+		}
+};
+
+// XOR of block, read machine word at a time
+inline uint8_t ds2XorBlock(const uint8_t data[], uint8_t length) {
+	uint8_t result = 0;
+	for(; length != 0 && (uintptr_t) data % sizeof(uintptr_t) != 0; length--) result ^= *data++;
+	uintptr_t wide = 0;
+	for(; length >= sizeof(uintptr_t); length -= sizeof(uintptr_t), data += sizeof(uintptr_t)) {
+		uintptr_t word;
+		memcpy(&word, data, sizeof(word));
+		wide ^= word;
+	}
+	for(uint8_t shift = sizeof(uintptr_t) * 4; shift >= 8; shift /= 2) wide ^= wide >> shift;
+	result ^= (uint8_t) wide;
+	for(; length != 0; length--) result ^= *data++;
+	return result;
+}
+
+template<class Protocol> ParseState DS2Parser::feedAs(uint8_t value) {
+	if(state != PARSE_WAITING) return state;
+	
+	// Resync on device byte, anything before it is noise or leftover from previous frame
+	if(Protocol::resync() && device != 0 && index == 0 && value != device) {
+		if(discarded < 255) discarded++;
+		return state;
+	}
+	
+	const uint8_t lengthIndex = Protocol::lengthIndex();
+	if(!echoPhase || !strip || index <= lengthIndex) buffer[position++] = value;
+	if(echoPhase && sent != nullptr && value != sent[index]) echoMatch = false;
+	checksum ^= value;
+	index++;
+	
+	if(index == lengthIndex + 1) {
+		uint8_t length = value + Protocol::lengthExtra();
+		if(echoPhase && length != echoLength) {
+			// No echo on this interface, what we have so far is response and it's already at start of buffer
+			echoPhase = false;
+			echoLength = 0;
+		}
+		if(length < Protocol::minLength()) return (state = PARSE_BAD);
+		// Stripped echo is never stored, only frame that goes into buffer has to fit
+		if(!(echoPhase && strip) && position - index + length > maxLength) return (state = PARSE_BAD);
+		frameLength = length;
+	}
+	
+	if(index != frameLength) return state;
+	return endFrame();
+}
+
+template<class Protocol> ParseState DS2Parser::feedAs(const uint8_t data[], uint8_t length) {
+	while(length != 0 && state == PARSE_WAITING) {
+		if(frameLength == 0) {
+			// Header until length byte, also handles resync
+			feedAs<Protocol>(*data++);
+			length--;
+			continue;
+		}
+		uint8_t chunk = frameLength - index;
+		if(chunk > length) chunk = length;
+		if(echoPhase && sent != nullptr && memcmp(sent + index, data, chunk) != 0) echoMatch = false;
+		if(!echoPhase || !strip) {
+			memcpy(buffer + position, data, chunk);
+			position += chunk;
+		}
+		checksum ^= ds2XorBlock(data, chunk);
+		index += chunk;
+		data += chunk;
+		length -= chunk;
+		if(index == frameLength) endFrame();
+	}
+	return state;
+}
+
+#endif /* DS2Parser_h */
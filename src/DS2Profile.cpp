@@ -0,0 +1,231 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Profile.h>
+
+
+static uint16_t getU16(const uint8_t data[]) {
+	return data[0] | (uint16_t) data[1] << 8;
+}
+
+static uint32_t getU32(const uint8_t data[]) {
+	return getU16(data) | (uint32_t) getU16(data + 2) << 16;
+}
+
+static void putU16(uint8_t data[], uint16_t value) {
+	data[0] = value;
+	data[1] = value >> 8;
+}
+
+static void putU32(uint8_t data[], uint32_t value) {
+	putU16(data, value);
+	putU16(data + 2, value >> 16);
+}
+
+
+bool DS2ProfileMemory::read(uint32_t offset, uint8_t buffer[], uint16_t length) {
+	if(offset > size || length > size - offset) return false;
+#if defined(__AVR__)
+	if(progmem) {
+		memcpy_P(buffer, data + offset, length);
+		return true;
+	}
+#endif
+	memcpy(buffer, data + offset, length);
+	return true;
+}
+
+
+bool DS2ProfileDatabase::begin() {
+	uint8_t header[DS2_PROFILE_HEADER];
+	count = 0;
+	if(!read(0, header, sizeof(header))) return false;
+	if(memcmp(header, "DS2P", 4) != 0 || header[4] != DS2_PROFILE_VERSION) return false;
+	count = getU16(header + 6);
+	indexOffset = getU32(header + 8);
+	return true;
+}
+
+bool DS2ProfileDatabase::find(uint32_t key, uint32_t &offset, uint16_t &length) {
+	uint16_t low = 0, high = count;
+	uint8_t entry[DS2_PROFILE_ENTRY];
+	while(low < high) {
+		uint16_t middle = low + (high - low) / 2;
+		if(!read(indexOffset + (uint32_t) middle * DS2_PROFILE_ENTRY, entry, sizeof(entry))) return false;
+		uint32_t entryKey = getU32(entry);
+		if(entryKey == key) {
+			offset = getU32(entry + 4);
+			length = getU16(entry + 8);
+			return true;
+		}
+		if(entryKey < key) low = middle + 1;
+		else high = middle;
+	}
+	return false;
+}
+
+bool DS2ProfileDatabase::load(uint32_t key, const char *ecuId, DS2Profile &profile) {
+	uint32_t offset;
+	uint16_t length;
+	if(!find(key, offset, length) || length < 2 || length > DS2_PROFILE_RECORD) return false;
+	
+	// Id is compared in small pieces before anything goes into profile, so other id with same hash leaves
+	//	loaded profile as it was
+	if(ecuId != nullptr) {
+		uint16_t idLength = strlen(ecuId) + 1;
+		if(1 + idLength > length) return false;
+		uint8_t chunk[16];
+		for(uint16_t done = 0; done < idLength; done += sizeof(chunk)) {
+			uint16_t part = idLength - done;
+			if(part > sizeof(chunk)) part = sizeof(chunk);
+			if(!read(offset + 1 + done, chunk, part) || memcmp(chunk, ecuId + done, part) != 0) return false;
+		}
+	}
+	
+	if(read(offset, profile.record, length) && parse(profile, length)) {
+		profile.key = key;
+		return true;
+	}
+	// Record is in profile's buffer already, old names would point into it
+	profile.key = 0;
+	profile.ecuId = profile.name = "";
+	profile.count = 0;
+	return false;
+}
+
+bool DS2ProfileDatabase::parse(DS2Profile &profile, uint16_t length) {
+	// Walk record, every string has to end inside it
+	const uint8_t *record = profile.record;
+	uint8_t channels = record[0];
+	if(channels > DS2_PROFILE_CHANNELS) return false;
+	uint16_t position = 1;
+	const char *id = (const char *) record + position;
+	while(position < length && record[position] != 0) position++;
+	if(position++ >= length) return false;
+	const char *name = (const char *) record + position;
+	while(position < length && record[position] != 0) position++;
+	if(position++ >= length) return false;
+	for(uint8_t i = 0; i < channels; i++) {
+		if(position + 12 >= length) return false;
+		DS2Channel &channel = profile.channels[i];
+		channel.offset = record[position];
+		channel.width = record[position + 1];
+		channel.flags = record[position + 2];
+		channel.shift = record[position + 3];
+		channel.multiplier = (int32_t) getU32(record + position + 4);
+		channel.addend = (int32_t) getU32(record + position + 8);
+		position += 12;
+		channel.name = (const char *) record + position;
+		while(position < length && record[position] != 0) position++;
+		if(position++ >= length) return false;
+	}
+	profile.ecuId = id;
+	profile.name = name;
+	profile.count = channels;
+	return true;
+}
+
+bool DS2ProfileDatabase::read(uint32_t offset, uint8_t data[], uint16_t length) {
+	reads++;
+	return source.read(offset, data, length);
+}
+
+uint32_t DS2ProfileDatabase::key(const char *ecuId) {
+	uint32_t number = 0;
+	uint8_t digits = 0;
+	for(; ecuId[digits] >= '0' && ecuId[digits] <= '9' && digits < 10; digits++) number = number * 10 + ecuId[digits] - '0';
+	// Leading zero would give same number as id without it, so such ids are hashed
+	if(digits != 0 && digits <= 9 && ecuId[digits] == 0 && (ecuId[0] != '0' || digits == 1)) return number;
+	// FNV-1a
+	uint32_t hash = 2166136261UL;
+	for(; *ecuId != 0; ecuId++) {
+		hash ^= (uint8_t) *ecuId;
+		hash *= 16777619UL;
+	}
+	return hash | 0x80000000UL;
+}
+
+uint16_t DS2ProfileDatabase::recordLength(const DS2ProfileDef &profile) {
+	uint32_t length = 1 + strlen(profile.ecuId) + 1 + strlen(profile.name) + 1;
+	for(uint8_t i = 0; i < profile.count; i++) length += 12 + strlen(profile.channels[i].name) + 1;
+	return length > DS2_PROFILE_RECORD ? 0 : length;
+}
+
+uint32_t DS2ProfileDatabase::write(Print &out, const DS2ProfileDef profiles[], uint16_t count) {
+	// Index and records go out in key order; profiles are picked by selection so nothing has to be allocated
+	uint32_t recordsSize = 0;
+	for(uint16_t i = 0; i < count; i++) {
+		uint16_t length = recordLength(profiles[i]);
+		if(length == 0 || profiles[i].count > DS2_PROFILE_CHANNELS) return 0;
+		recordsSize += length;
+		for(uint16_t j = 0; j < i; j++) {
+			if(key(profiles[i].ecuId) == key(profiles[j].ecuId)) return 0;
+		}
+	}
+	uint32_t indexOffset = DS2_PROFILE_HEADER;
+	uint32_t total = indexOffset + (uint32_t) count * DS2_PROFILE_ENTRY + recordsSize;
+	
+	uint8_t header[DS2_PROFILE_HEADER] = {'D', 'S', '2', 'P', DS2_PROFILE_VERSION, 0};
+	putU16(header + 6, count);
+	putU32(header + 8, indexOffset);
+	putU32(header + 12, total);
+	uint32_t written = out.write(header, sizeof(header));
+	
+	// Pass 0 writes index, pass 1 records
+	for(uint8_t pass = 0; pass < 2; pass++) {
+		uint32_t offset = indexOffset + (uint32_t) count * DS2_PROFILE_ENTRY;
+		bool first = true;
+		uint32_t previous = 0;
+		for(uint16_t n = 0; n < count; n++) {
+			uint16_t next = count;
+			uint32_t nextKey = 0;
+			for(uint16_t i = 0; i < count; i++) {
+				uint32_t profileKey = key(profiles[i].ecuId);
+				if(!first && profileKey <= previous) continue;
+				if(next == count || profileKey < nextKey) {
+					next = i;
+					nextKey = profileKey;
+				}
+			}
+			const DS2ProfileDef &profile = profiles[next];
+			uint16_t length = recordLength(profile);
+			if(pass == 0) {
+				uint8_t entry[DS2_PROFILE_ENTRY];
+				putU32(entry, nextKey);
+				putU32(entry + 4, offset);
+				putU16(entry + 8, length);
+				written += out.write(entry, sizeof(entry));
+			} else {
+				written += out.write(profile.count);
+				written += out.write((const uint8_t *) profile.ecuId, strlen(profile.ecuId) + 1);
+				written += out.write((const uint8_t *) profile.name, strlen(profile.name) + 1);
+				for(uint8_t i = 0; i < profile.count; i++) {
+					const DS2Channel &channel = profile.channels[i];
+					uint8_t packed[12] = {channel.offset, channel.width, channel.flags, channel.shift};
+					putU32(packed + 4, (uint32_t) channel.multiplier);
+					putU32(packed + 8, (uint32_t) channel.addend);
+					written += out.write(packed, sizeof(packed));
+					written += out.write((const uint8_t *) channel.name, strlen(channel.name) + 1);
+				}
+			}
+			offset += length;
+			previous = nextKey;
+			first = false;
+		}
+	}
+	return written == total ? written : 0;
+}
@@ -0,0 +1,165 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Profile
+*	ECU profile database - channel layout for every ECU software variant in one binary file kept in flash or on SD.
+*	Only sorted index is searched (binary search, log2(n) reads of 10 bytes), then one record is read into DS2Profile,
+*	so RAM use doesn't grow with number of profiles.
+
+*	File format (little endian):
+	-	header, 16 bytes - "DS2P", version, 0, profile count (2), index offset (4), file size (4)
+	-	index, 10 bytes per profile sorted by key - key (4), record offset (4), record length (2)
+	-	records - channel count, ECU id with 0, profile name with 0, then per channel:
+		offset, width, flags, shift, multiplier (4), addend (4), channel name with 0
+	Key is ECU id as number ("7551615" -> 7551615), ids that are not 9 digits or less (or start with 0) get 32 bit
+	hash with top bit set. Hash can collide, so load(ecuId) also compares id stored in record - unknown id whose
+	hash matches some profile is not found instead of loading wrong one.
+
+*	Usage:
+	File file = SD.open("/profiles.bin");
+	DS2ProfileFile<File> source(file);
+	DS2ProfileDatabase profiles(source);
+	DS2Profile profile;
+	if(profiles.begin() && profiles.load(ecuIdString, profile)) {
+		DS2ChannelTable table = profile.getTable();
+		...
+	}
+	Database is made with DS2ProfileDatabase::write from DS2ProfileDef list - on host, or on board straight to SD.
+**/
+
+#ifndef DS2Profile_h
+#define DS2Profile_h
+
+#include "DS2Channel.h"
+
+#define DS2_PROFILE_HEADER 16
+#define DS2_PROFILE_ENTRY 10
+#define DS2_PROFILE_VERSION 2
+
+// Room in one loaded profile
+#ifndef DS2_PROFILE_CHANNELS
+	#if defined(__AVR__)
+		#define DS2_PROFILE_CHANNELS 16
+	#else
+		#define DS2_PROFILE_CHANNELS 64
+	#endif
+#endif
+#ifndef DS2_PROFILE_RECORD
+	#if defined(__AVR__)
+		#define DS2_PROFILE_RECORD 192
+	#else
+		#define DS2_PROFILE_RECORD 1024
+	#endif
+#endif
+
+
+// Where database bytes come from
+class DS2ProfileSource {
+	public:
+		virtual ~DS2ProfileSource() {}
+		virtual bool read(uint32_t offset, uint8_t data[], uint16_t length) = 0;
+};
+
+// Database in memory - ESP32 flash is memory mapped so const array works directly; on AVR set progmem for PROGMEM array
+class DS2ProfileMemory : public DS2ProfileSource {
+	public:
+		DS2ProfileMemory(const uint8_t data[], uint32_t size, bool progmem = false):data(data), size(size), progmem(progmem) {}
+		bool read(uint32_t offset, uint8_t buffer[], uint16_t length) override;
+		
+	private:
+		const uint8_t *data;
+		uint32_t size;
+		bool progmem;
+};
+
+// Database in file, anything with seek and read(buffer, length) - SD File, SPIFFS, LittleFS
+template <class FileType>
+class DS2ProfileFile : public DS2ProfileSource {
+	public:
+		DS2ProfileFile(FileType &file):file(file) {}
+		bool read(uint32_t offset, uint8_t data[], uint16_t length) override {
+			return file.seek(offset) && file.read(data, length) == length;
+		}
+		
+	private:
+		FileType &file;
+};
+
+// One profile for writing database
+struct DS2ProfileDef {
+	const char *ecuId;
+	const char *name;
+	const DS2Channel *channels;
+	uint8_t count;
+};
+
+// Loaded profile, channel names point into record
+class DS2Profile {
+	public:
+		uint32_t getKey() const { return key; }
+		const char *getEcuId() const { return ecuId; }
+		const char *getName() const { return name; }
+		uint8_t getCount() const { return count; }
+		const DS2Channel &getChannel(uint8_t index) const { return channels[index]; }
+		DS2ChannelTable getTable() const { return DS2ChannelTable(channels, count); }
+		
+	private:
+		friend class DS2ProfileDatabase;
+		uint32_t key = 0;
+		const char *ecuId = "";
+		const char *name = "";
+		uint8_t count = 0;
+		DS2Channel channels[DS2_PROFILE_CHANNELS];
+		uint8_t record[DS2_PROFILE_RECORD];
+};
+
+
+class DS2ProfileDatabase {
+	public:
+		DS2ProfileDatabase(DS2ProfileSource &source):source(source) {}
+		
+		bool begin(); // reads and checks header
+		uint16_t getCount() { return count; }
+		uint32_t getReads() { return reads; } // source reads so far
+		
+		// Binary search in index; record offset and length are set if found
+		bool find(uint32_t key, uint32_t &offset, uint16_t &length);
+		// Finds and reads profile; false if it is not there or doesn't fit DS2Profile. Profile loaded before is kept
+		//	when id is not there, but broken record (read error, truncated file) leaves it empty
+		bool load(uint32_t key, DS2Profile &profile) { return load(key, nullptr, profile); }
+		// Same, and stored id has to match too
+		bool load(const char *ecuId, DS2Profile &profile) { return load(key(ecuId), ecuId, profile); }
+		
+		// Index key of ECU id string
+		static uint32_t key(const char *ecuId);
+		// Writes whole database, returns bytes written or 0 if keys repeat (same id or hash collision) or record is over
+		//	DS2_PROFILE_RECORD
+		static uint32_t write(Print &out, const DS2ProfileDef profiles[], uint16_t count);
+		
+	private:
+		DS2ProfileSource &source;
+		uint16_t count = 0;
+		uint32_t indexOffset = 0;
+		uint32_t reads = 0;
+		
+		bool read(uint32_t offset, uint8_t data[], uint16_t length);
+		bool load(uint32_t key, const char *ecuId, DS2Profile &profile);
+		static bool parse(DS2Profile &profile, uint16_t length);
+		static uint16_t recordLength(const DS2ProfileDef &profile);
+};
+
+#endif /* DS2Profile_h */
@@ -0,0 +1,75 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Protocol, KWPProtocol
+*	Header layout of both protocols as compile time descriptors. Everything is constexpr so code templated on
+*	protocol (DS2Parser::feedAs, BasicDS2) gets offsets folded into constants and kwp branches removed.
+*	Runtime selected code (DS2, DS2Frame) picks one of them with kwp flag.
+
+*	DS2 - device, length (whole frame), ack/command, payload..., checksum
+*	KWP - format, target, source, length (payload only, frame is length + 5), payload..., checksum
+**/
+
+#ifndef DS2Protocol_h
+#define DS2Protocol_h
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+  #include "pins_arduino.h"
+  #include "WConstants.h"
+#endif
+
+
+struct DS2Protocol {
+	static constexpr bool isKwp() { return false; }
+	static constexpr uint8_t header() { return 3; } // payload starts here
+	static constexpr uint8_t lengthIndex() { return 1; }
+	static constexpr uint8_t lengthExtra() { return 0; } // frame length = length byte + extra
+	static constexpr uint8_t targetIndex() { return 0; } // device command is sent to
+	static constexpr uint8_t senderIndex() { return 0; } // device response comes from
+	static constexpr uint8_t ackIndex() { return 2; }
+	static constexpr uint8_t minLength() { return 3; } // device, length, checksum
+	static constexpr bool resync() { return true; } // frames start with known device byte, so noise before it can be skipped
+	
+	static constexpr uint8_t frameLength(const uint8_t data[]) { return data[lengthIndex()] + lengthExtra(); }
+	static constexpr uint8_t target(const uint8_t data[]) { return data[targetIndex()]; }
+	static constexpr uint8_t sender(const uint8_t data[]) { return data[senderIndex()]; }
+	// Positive response - A0 ack byte
+	static constexpr bool isOk(const uint8_t response[], uint8_t) { return response[ackIndex()] == 0xA0; }
+};
+
+struct KWPProtocol {
+	static constexpr bool isKwp() { return true; }
+	static constexpr uint8_t header() { return 4; }
+	static constexpr uint8_t lengthIndex() { return 3; }
+	static constexpr uint8_t lengthExtra() { return 5; }
+	static constexpr uint8_t targetIndex() { return 1; }
+	static constexpr uint8_t senderIndex() { return 2; }
+	static constexpr uint8_t ackIndex() { return 4; } // service id of response
+	static constexpr uint8_t minLength() { return 5; }
+	static constexpr bool resync() { return false; } // first byte is format, not device
+	
+	static constexpr uint8_t frameLength(const uint8_t data[]) { return data[lengthIndex()] + lengthExtra(); }
+	static constexpr uint8_t target(const uint8_t data[]) { return data[targetIndex()]; }
+	static constexpr uint8_t sender(const uint8_t data[]) { return data[senderIndex()]; }
+	// Response is from device request was sent to
+	static constexpr bool isOk(const uint8_t response[], uint8_t device) { return response[senderIndex()] == device; }
+};
+
+#endif /* DS2Protocol_h */
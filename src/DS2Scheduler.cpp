@@ -0,0 +1,168 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Scheduler.h>
+
+// Weight of newest sample in averaged response interval is 1/2^INTERVAL_SHIFT
+#define INTERVAL_SHIFT 3
+
+
+static uint32_t hzToPeriod(float hz) {
+	return hz > 0 ? (uint32_t) (1000000.0 / hz) : 0;
+}
+
+uint8_t DS2Scheduler::add(uint8_t command[], float hz, uint8_t priority) {
+	if(size >= DS2_SCHEDULER_SIZE) return DS2_SCHEDULER_NONE;
+	DS2ScheduleEntry &entry = entries[size];
+	entry.command = command;
+	entry.period = hzToPeriod(hz);
+	entry.priority = priority;
+	entry.enabled = true;
+	entry.triggered = false;
+	entry.nextDue = micros();
+	entry.lastResponse = 0;
+	entry.interval = 0;
+	entry.responses = entry.timeouts = entry.bad = 0;
+	return size++;
+}
+
+void DS2Scheduler::setRate(uint8_t index, float hz) {
+	if(index < size) entries[index].period = hzToPeriod(hz);
+}
+
+void DS2Scheduler::setPriority(uint8_t index, uint8_t priority) {
+	if(index < size) entries[index].priority = priority;
+}
+
+void DS2Scheduler::setEnabled(uint8_t index, bool enabled) {
+	if(index < size) entries[index].enabled = enabled;
+}
+
+void DS2Scheduler::trigger(uint8_t index) {
+	if(index < size) entries[index].triggered = true;
+}
+
+void DS2Scheduler::clear() {
+	if(current != DS2_SCHEDULER_NONE) ds2.newCommand();
+	size = 0;
+	current = lastIndex = DS2_SCHEDULER_NONE;
+}
+
+ReceiveType DS2Scheduler::poll(uint8_t data[]) {
+	ReceiveType result = RECEIVE_WAITING;
+	if(current != DS2_SCHEDULER_NONE) {
+		result = ds2.receiveData(data);
+		if(result == RECEIVE_WAITING) return result;
+		record(current, result, micros());
+		lastIndex = current;
+		current = DS2_SCHEDULER_NONE;
+	}
+	sendNext();
+	return result;
+}
+
+// Triggered commands first, then overdue ones by earliest deadline - when bus can't keep up every command
+// slows down in proportion to its rate and none starves. If nothing is overdue spare bus time goes to
+// highest priority so bus is never idle
+uint8_t DS2Scheduler::pickNext(uint32_t now) {
+	uint8_t best = DS2_SCHEDULER_NONE;
+	bool bestOverdue = false;
+	for(uint8_t i = 0; i < size; i++) {
+		DS2ScheduleEntry &entry = entries[i];
+		if(!entry.enabled) continue;
+		if(entry.triggered) return i;
+		if(entry.period == 0) continue;
+		
+		bool overdue = (int32_t) (now - entry.nextDue) >= 0;
+		if(best == DS2_SCHEDULER_NONE) {
+			best = i;
+			bestOverdue = overdue;
+			continue;
+		}
+		DS2ScheduleEntry &other = entries[best];
+		bool better;
+		if(overdue != bestOverdue) better = overdue;
+		else if(!overdue && entry.priority != other.priority) better = entry.priority > other.priority;
+		else better = (int32_t) (entry.nextDue - other.nextDue) < 0;
+		if(better) {
+			best = i;
+			bestOverdue = overdue;
+		}
+	}
+	return best;
+}
+
+void DS2Scheduler::sendNext() {
+	uint32_t now = micros();
+	uint8_t next = pickNext(now);
+	if(next == DS2_SCHEDULER_NONE) return;
+	if(ds2.sendCommand(entries[next].command) == 0) return; // someone else is using the bus
+	
+	DS2ScheduleEntry &entry = entries[next];
+	current = next;
+	if(entry.triggered) {
+		entry.triggered = false;
+		return;
+	}
+	// Keep phase while we keep up, don't try to catch up missed slots with a burst
+	bool early = (int32_t) (now - entry.nextDue) < 0;
+	entry.nextDue = (early ? now : entry.nextDue) + entry.period;
+	if((int32_t) (now - entry.nextDue) > 0) entry.nextDue = now;
+}
+
+void DS2Scheduler::record(uint8_t index, ReceiveType result, uint32_t now) {
+	DS2ScheduleEntry &entry = entries[index];
+	switch(result) {
+		case RECEIVE_OK:
+			entry.responses++;
+			if(entry.lastResponse != 0) {
+				uint32_t sample = now - entry.lastResponse;
+				if(entry.interval == 0) entry.interval = sample;
+				else entry.interval = entry.interval - (entry.interval >> INTERVAL_SHIFT) + (sample >> INTERVAL_SHIFT);
+			}
+			entry.lastResponse = now;
+			break;
+		case RECEIVE_TIMEOUT:
+			entry.timeouts++;
+			break;
+		default:
+			entry.bad++;
+			break;
+	}
+}
+
+float DS2Scheduler::getRequestedRate(uint8_t index) {
+	if(index >= size || entries[index].period == 0) return 0;
+	return 1000000.0 / entries[index].period;
+}
+
+float DS2Scheduler::getAchievedRate(uint8_t index) {
+	if(index >= size) return 0;
+	DS2ScheduleEntry &entry = entries[index];
+	if(entry.interval == 0) return 0;
+	uint32_t sinceLast = micros() - entry.lastResponse;
+	return 1000000.0 / (sinceLast > entry.interval ? sinceLast : entry.interval);
+}
+
+void DS2Scheduler::resetStats() {
+	for(uint8_t i = 0; i < size; i++) {
+		DS2ScheduleEntry &entry = entries[i];
+		entry.responses = entry.timeouts = entry.bad = 0;
+		entry.interval = 0;
+		entry.lastResponse = 0;
+	}
+}
@@ -0,0 +1,97 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Scheduler
+*	Polls several commands over one DS2 with target rate (Hz) and priority for each one.
+*	There is always exactly one request on the bus - next one is sent the moment previous response (or timeout) is in,
+*	so K-line never waits for the rest of your loop.
+
+*	Next command is chosen earliest deadline first, deadline being last send + 1/rate, so when bus can't keep up
+	each command gets share of ~15-30 rps budget in proportion to its rate - fast channels like RPM get more.
+	Priority decides where spare bus time goes when nothing is overdue and breaks ties.
+	Rate 0 means command is sent only after trigger() - i.e. ECU id on reconnect.
+
+*	Usage:
+	DS2Scheduler scheduler(DS2);
+	uint8_t fast = scheduler.add(generalValues, 20, 1);
+	void loop() {
+		if(scheduler.poll(data) == RECEIVE_OK && scheduler.getIndex() == fast) { ... }
+	}
+**/
+
+#ifndef DS2Scheduler_h
+#define DS2Scheduler_h
+
+#include "DS2.h"
+
+// Max commands in one scheduler
+#ifndef DS2_SCHEDULER_SIZE
+#define DS2_SCHEDULER_SIZE 8
+#endif
+
+#define DS2_SCHEDULER_NONE 0xFF
+
+
+struct DS2ScheduleEntry {
+	uint8_t *command;
+	uint32_t period; // us, 0 - only when triggered
+	uint8_t priority; // higher gets spare bus time
+	bool enabled;
+	bool triggered;
+	uint32_t nextDue; // micros
+	uint32_t lastResponse; // micros
+	uint32_t interval; // averaged time between responses in us
+	uint32_t responses, timeouts, bad;
+};
+
+
+class DS2Scheduler {
+	public:
+		DS2Scheduler(DS2 &ds2):ds2(ds2) {}
+		
+		// Returns index of command or DS2_SCHEDULER_NONE if table is full
+		uint8_t add(uint8_t command[], float hz, uint8_t priority = 0);
+		void setRate(uint8_t index, float hz);
+		void setPriority(uint8_t index, uint8_t priority);
+		void setEnabled(uint8_t index, bool enabled);
+		void trigger(uint8_t index); // sends command once, as soon as bus is free
+		void clear();
+		
+		// Call in loop; returns result of response that just came in and keeps next request on the bus
+		ReceiveType poll(uint8_t data[]);
+		uint8_t getIndex() { return lastIndex; } // which command poll() result belongs to
+		uint8_t getPending() { return current; } // command on the bus now
+		
+		uint8_t getSize() { return size; }
+		float getRequestedRate(uint8_t index);
+		float getAchievedRate(uint8_t index); // responses per second
+		const DS2ScheduleEntry &getEntry(uint8_t index) { return entries[index]; }
+		void resetStats();
+		
+	private:
+		DS2 &ds2;
+		DS2ScheduleEntry entries[DS2_SCHEDULER_SIZE];
+		uint8_t size = 0;
+		uint8_t current = DS2_SCHEDULER_NONE;
+		uint8_t lastIndex = DS2_SCHEDULER_NONE;
+		
+		uint8_t pickNext(uint32_t now);
+		void sendNext();
+		void record(uint8_t index, ReceiveType result, uint32_t now);
+};
+
+#endif /* DS2Scheduler_h */
@@ -0,0 +1,166 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Session.h>
+
+
+static void putU32(uint8_t data[], uint32_t value) {
+	for(uint8_t i = 0; i < 4; i++) data[i] = value >> (8 * i);
+}
+
+static uint32_t getU32(const uint8_t data[]) {
+	return data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+}
+
+
+bool DS2Session::capture(const uint8_t idCommand[], const DS2Frame &idResponse) {
+	kwp = ds2.getKwp();
+	uint8_t length = ds2CommandLength(idCommand, kwp);
+	if(length > DS2_SESSION_COMMAND || !idResponse.isValid()) return (valid = false);
+	memcpy(command, idCommand, length);
+	device = kwp ? KWPProtocol::target(idCommand) : DS2Protocol::target(idCommand);
+	idLength = idResponse.getArray(id, 0, DS2_SESSION_ID);
+	return (valid = true);
+}
+
+bool DS2Session::resume(uint8_t data[]) {
+	if(!valid) return false;
+	ds2.setKwp(kwp);
+	ds2.setDevice(device);
+	DS2BaudControl *control = ds2.getBaudControl();
+	uint32_t previousBaud = control ? control->getBaud() : 0;
+	bool switched = control && baud != 0 && baud != previousBaud && control->setBaud(baud);
+	if(switched) ds2.clearRX();
+	for(uint8_t i = 0; i < entryCount; i++) ds2.getLengthCache().restore(entries[i]);
+	
+	if(ds2.obtainValues(command, data)) {
+		DS2Frame frame = ds2.getFrame();
+		uint8_t check[DS2_SESSION_ID];
+		if(frame.getArray(check, 0, DS2_SESSION_ID) == idLength && memcmp(check, id, idLength) == 0) return true;
+	}
+	
+	// Not the ECU we saved, go back to cold state
+	if(switched) {
+		control->setBaud(previousBaud);
+		ds2.clearRX();
+	}
+	ds2.getLengthCache().clear();
+	return false;
+}
+
+uint16_t DS2Session::pack(uint8_t record[], uint16_t size) {
+	if(!valid || size < DS2_SESSION_SIZE) return 0;
+	record[0] = 'D';
+	record[1] = 'S';
+	record[2] = 'S';
+	record[3] = DS2_SESSION_VERSION;
+	record[4] = kwp ? 1 : 0;
+	record[5] = device;
+	putU32(record + 6, ds2.getBaud());
+	uint16_t position = 10;
+	uint8_t length = ds2CommandLength(command, kwp);
+	record[position++] = length;
+	memcpy(record + position, command, length);
+	position += length;
+	record[position++] = idLength;
+	memcpy(record + position, id, idLength);
+	position += idLength;
+	
+	// Learned lengths and turnarounds as they are now
+	uint16_t countAt = position++;
+	uint8_t count = 0;
+	for(uint8_t i = 0; i < DS2_LENGTH_CACHE; i++) {
+		const DS2LengthEntry &entry = ds2.getLengthCache().getEntry(i);
+		if(entry.hash == 0) continue;
+		record[position] = entry.hash;
+		record[position + 1] = entry.hash >> 8;
+		record[position + 2] = entry.length;
+		record[position + 3] = entry.samples;
+		putU32(record + position + 4, entry.turnaround);
+		putU32(record + position + 8, entry.deviation);
+		position += DS2_SESSION_ENTRY;
+		count++;
+	}
+	record[countAt] = count;
+	uint16_t check = hash(record, position);
+	record[position++] = check;
+	record[position++] = check >> 8;
+	return position;
+}
+
+bool DS2Session::unpack(const uint8_t record[], uint16_t length) {
+	valid = false;
+	if(length < 15 || memcmp(record, "DSS", 3) != 0 || record[3] != DS2_SESSION_VERSION) return false;
+	if(hash(record, length - 2) != (record[length - 2] | (uint16_t) record[length - 1] << 8)) return false;
+	kwp = record[4] & 1;
+	device = record[5];
+	baud = getU32(record + 6);
+	uint16_t position = 10;
+	uint16_t end = length - 2;
+	
+	uint8_t commandLength = record[position++];
+	if(commandLength > DS2_SESSION_COMMAND || position + commandLength >= end) return false;
+	memcpy(command, record + position, commandLength);
+	position += commandLength;
+	if(ds2CommandLength(command, kwp) != commandLength) return false;
+	
+	idLength = record[position++];
+	if(idLength > DS2_SESSION_ID || position + idLength >= end) return false;
+	memcpy(id, record + position, idLength);
+	position += idLength;
+	
+	entryCount = record[position++];
+	if(entryCount > DS2_LENGTH_CACHE || position + entryCount * DS2_SESSION_ENTRY != end) return false;
+	for(uint8_t i = 0; i < entryCount; i++, position += DS2_SESSION_ENTRY) {
+		DS2LengthEntry &entry = entries[i];
+		entry.hash = record[position] | (uint16_t) record[position + 1] << 8;
+		entry.length = record[position + 2];
+		entry.samples = record[position + 3];
+		entry.turnaround = getU32(record + position + 4);
+		entry.deviation = getU32(record + position + 8);
+		entry.backoff = false;
+	}
+	return (valid = true);
+}
+
+size_t DS2Session::save(Print &out) {
+	uint8_t record[DS2_SESSION_SIZE];
+	uint16_t length = pack(record, sizeof(record));
+	if(length == 0) return 0;
+	uint8_t size[2] = {(uint8_t) length, (uint8_t) (length >> 8)};
+	if(out.write(size, 2) != 2) return 0;
+	return out.write(record, length) == length ? length + 2 : 0;
+}
+
+bool DS2Session::load(Stream &in) {
+	uint8_t size[2];
+	uint8_t record[DS2_SESSION_SIZE];
+	if(in.readBytes(size, 2) != 2) return (valid = false);
+	uint16_t length = size[0] | (uint16_t) size[1] << 8;
+	if(length > sizeof(record) || in.readBytes(record, length) != length) return (valid = false);
+	return unpack(record, length);
+}
+
+// FNV-1a folded to 16 bits
+uint16_t DS2Session::hash(const uint8_t data[], uint16_t length) {
+	uint32_t value = 2166136261UL;
+	for(uint16_t i = 0; i < length; i++) {
+		value ^= data[i];
+		value *= 16777619UL;
+	}
+	return (value >> 16) ^ (value & 0xFFFF);
+}
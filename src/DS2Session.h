@@ -0,0 +1,97 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Session
+*	Warm start - what was found out about the car last time is saved (ECU id, device, protocol, baud, learned
+*	response lengths and turnarounds) and at next boot confirmed with single ECU id request instead of handshake,
+*	baud switch and learning from scratch. First sample request goes out right after that one round trip.
+
+*	Usage:
+	DS2Session session(DS2);
+	// setup()
+	if(!(loaded && session.resume(data))) {
+		while(!DS2.obtainValues(ecuId, data));		// cold start as before
+		session.capture(ecuId, DS2.getFrame());
+		...switchBaud etc
+	}
+	// later, when learning had few responses (or before sleep) - save snapshot of current state
+	uint8_t record[DS2_SESSION_SIZE];
+	preferences.putBytes("ds2", record, session.pack(record, sizeof(record))); // NVS on ESP32
+	// or session.save(file) / session.load(file) for SD, SPIFFS
+	
+*	resume() sets saved protocol, device and baud (transport only, ECU is expected to be still there), puts learned
+	lengths back and sends saved id command once. If reply doesn't match saved id (ECU was reset or it's other car)
+	DS2 gets previous baud back, learned data is cleared and false is returned, so cold start can follow.
+
+*	Record (little endian): "DSS", version, flags (1 - kwp), device, baud (4), id command length and bytes,
+	id length and bytes, learned entry count and entries (hash 2, length, samples, turnaround 4, deviation 4),
+	FNV-1a 16 bit of everything before it.
+**/
+
+#ifndef DS2Session_h
+#define DS2Session_h
+
+#include "DS2.h"
+
+#define DS2_SESSION_VERSION 1
+// Longest ECU id command and id reply payload kept
+#ifndef DS2_SESSION_COMMAND
+#define DS2_SESSION_COMMAND 16
+#endif
+#ifndef DS2_SESSION_ID
+#define DS2_SESSION_ID 16
+#endif
+#define DS2_SESSION_ENTRY 12
+#define DS2_SESSION_SIZE (10 + 1 + DS2_SESSION_COMMAND + 1 + DS2_SESSION_ID + 1 + DS2_LENGTH_CACHE * DS2_SESSION_ENTRY + 2)
+
+
+class DS2Session {
+	public:
+		DS2Session(DS2 &ds2):ds2(ds2) {}
+		
+		// Keeps id command and its reply after cold start; false if they don't fit
+		bool capture(const uint8_t idCommand[], const DS2Frame &idResponse);
+		bool isValid() { return valid; }
+		// Applies saved state and checks it with one id request, see above
+		bool resume(uint8_t data[]);
+		
+		// Snapshot of DS2 state now plus captured id; returns bytes used, 0 if nothing captured or size too small
+		uint16_t pack(uint8_t record[], uint16_t size);
+		bool unpack(const uint8_t record[], uint16_t length); // false if record is broken or from other version
+		size_t save(Print &out);
+		bool load(Stream &in);
+		
+		const uint8_t *getEcuId() { return id; } // saved id reply payload
+		uint8_t getEcuIdLength() { return idLength; }
+		uint32_t getBaud() { return baud; }
+		
+	private:
+		DS2 &ds2;
+		bool valid = false;
+		bool kwp = false;
+		uint8_t device = 0;
+		uint32_t baud = 0;
+		uint8_t command[DS2_SESSION_COMMAND];
+		uint8_t id[DS2_SESSION_ID];
+		uint8_t idLength = 0;
+		uint8_t entryCount = 0;
+		DS2LengthEntry entries[DS2_LENGTH_CACHE];
+		
+		static uint16_t hash(const uint8_t data[], uint16_t length);
+};
+
+#endif /* DS2Session_h */
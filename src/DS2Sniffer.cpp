@@ -0,0 +1,197 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Sniffer.h>
+
+
+void DS2Sniffer::begin(bool useTask) {
+	end();
+	head = tail = 0;
+	requestLength = 0;
+	parser.reset();
+	running = true;
+#if defined(ESP32)
+	if(useTask) {
+		taskDone = false;
+		if(xTaskCreatePinnedToCore(readerTask, "DS2Sniffer", 4096, this, 2, &task, 0) != pdPASS) {
+			task = nullptr;
+			taskDone = true;
+		}
+	}
+#elif defined(DS2_HOST)
+	if(useTask) {
+		thread = std::thread([this]() {
+			while(running) {
+				service();
+				delay(1);
+			}
+		});
+	}
+#else
+	(void) useTask;
+#endif
+}
+
+void DS2Sniffer::end() {
+	if(!running) return;
+	running = false;
+#if defined(ESP32)
+	while(!taskDone) delay(1);
+	task = nullptr;
+#elif defined(DS2_HOST)
+	if(thread.joinable()) thread.join();
+#endif
+}
+
+void DS2Sniffer::service() {
+	uint32_t now = micros();
+	int count = serial.available();
+	// Bytes already waiting arrived one byte time apart, last one just now
+	uint8_t staging[DS2_STAGING];
+	for(int done = 0; done < count;) {
+		uint8_t length = serial.readBytes(staging, count - done > DS2_STAGING ? DS2_STAGING : count - done);
+		if(length == 0) break;
+		for(uint8_t i = 0; i < length; i++, done++) feed(staging[i], now - (count - 1 - done) * byteTime);
+	}
+	if(requestLength != 0 && now - requestAt > timeout) {
+		record(requestAt, request, requestLength, 0, nullptr, 0);
+		requestLength = 0;
+	}
+}
+
+void DS2Sniffer::feed(uint8_t value, uint32_t at) {
+	if(parser.getState() == PARSE_WAITING && at - lastByteAt > DS2_SNIFF_GAP) {
+		discarded += parser.getLength(); // frame never finished, new one starts here
+		parser.reset();
+	}
+	lastByteAt = at;
+	
+	retry[0] = value;
+	uint16_t count = 1, index = 0;
+	while(index < count) {
+		if(parser.getState() != PARSE_WAITING) {
+			parser.begin(frame, 0, 0, kwp);
+			frameAt = at - (count - 1 - index) * byteTime;
+		}
+		ParseState state = parser.feed(retry[index++]);
+		if(state == PARSE_COMPLETE) {
+			frameDone(parser.getLength());
+			parser.reset();
+		} else if(state == PARSE_BAD) {
+			// Wrong start - drop first byte, everything after it goes through parser again
+			uint8_t length = parser.getLength();
+			uint16_t left = count - index;
+			memmove(retry + length - 1, retry + index, left);
+			memcpy(retry, frame + 1, length - 1);
+			count = length - 1 + left;
+			index = 0;
+			discarded++;
+			parser.reset();
+		}
+	}
+}
+
+// DS2 - response comes from address request went to and has ack byte; KWP - target and source are swapped
+bool DS2Sniffer::isResponse(const uint8_t response[]) {
+	if(requestLength == 0) return false;
+	if(kwp) return response[1] == request[2] && response[2] == request[1];
+	uint8_t ack = response[2];
+	return response[0] == request[0] && (ack == 0xA0 || ack == 0xB0 || ack == 0xFF);
+}
+
+void DS2Sniffer::frameDone(uint8_t length) {
+	frames++;
+	if(isResponse(frame)) {
+		record(requestAt, request, requestLength, frameAt, frame, length);
+		requestLength = 0;
+		pairs++;
+		return;
+	}
+	if(requestLength != 0) record(requestAt, request, requestLength, 0, nullptr, 0); // previous got no answer
+	memcpy(request, frame, length);
+	requestLength = length;
+	requestAt = frameAt;
+}
+
+void DS2Sniffer::put(uint32_t position, const uint8_t bytes[], uint32_t length) {
+	uint32_t index = position % size;
+	uint32_t first = size - index;
+	if(first > length) first = length;
+	memcpy(buffer + index, bytes, first);
+	memcpy(buffer, bytes + first, length - first);
+}
+
+void DS2Sniffer::get(uint32_t position, uint8_t bytes[], uint32_t length) {
+	uint32_t index = position % size;
+	uint32_t first = size - index;
+	if(first > length) first = length;
+	memcpy(bytes, buffer + index, first);
+	memcpy(bytes + first, buffer, length - first);
+}
+
+void DS2Sniffer::record(uint32_t reqAt, const uint8_t req[], uint8_t reqLength, uint32_t respAt, const uint8_t resp[], uint8_t respLength) {
+	uint32_t recordLength = DS2_SNIFF_HEADER + reqLength + respLength;
+	uint32_t position = head;
+	if(position - tail + recordLength > size) {
+		dropped++;
+		return;
+	}
+	uint8_t header[DS2_SNIFF_HEADER] = {
+		(uint8_t) reqAt, (uint8_t) (reqAt >> 8), (uint8_t) (reqAt >> 16), (uint8_t) (reqAt >> 24),
+		(uint8_t) respAt, (uint8_t) (respAt >> 8), (uint8_t) (respAt >> 16), (uint8_t) (respAt >> 24),
+		reqLength, respLength
+	};
+	put(position, header, DS2_SNIFF_HEADER);
+	put(position + DS2_SNIFF_HEADER, req, reqLength);
+	put(position + DS2_SNIFF_HEADER + reqLength, resp, respLength);
+	DS2_BARRIER();
+	head = position + recordLength;
+}
+
+bool DS2Sniffer::read(DS2SniffRecord &record, uint8_t data[]) {
+	uint32_t position = tail;
+	if(head == position) return false;
+	DS2_BARRIER();
+	uint8_t header[DS2_SNIFF_HEADER];
+	get(position, header, DS2_SNIFF_HEADER);
+	record.requestAt = (uint32_t) header[0] | (uint32_t) header[1] << 8 | (uint32_t) header[2] << 16 | (uint32_t) header[3] << 24;
+	record.responseAt = (uint32_t) header[4] | (uint32_t) header[5] << 8 | (uint32_t) header[6] << 16 | (uint32_t) header[7] << 24;
+	record.requestLength = header[8];
+	record.responseLength = header[9];
+	get(position + DS2_SNIFF_HEADER, data, record.requestLength + record.responseLength);
+	record.request = data;
+	record.response = data + record.requestLength;
+	DS2_BARRIER();
+	tail = position + DS2_SNIFF_HEADER + record.requestLength + record.responseLength;
+	return true;
+}
+
+void DS2Sniffer::resetCounters() {
+	frames = pairs = discarded = dropped = 0;
+}
+
+#if defined(ESP32)
+void DS2Sniffer::readerTask(void *parameter) {
+	DS2Sniffer *sniffer = (DS2Sniffer *) parameter;
+	while(sniffer->running) {
+		sniffer->service();
+		vTaskDelay(1);
+	}
+	sniffer->taskDone = true;
+	vTaskDelete(nullptr);
+}
+#endif
@@ -0,0 +1,124 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Sniffer
+*	Passive monitor for K-line between tester and ECU. Frames are cut by length byte and checked by checksum
+*	with DS2Parser, bad ones are resynced by dropping first byte and parsing rest again, long gap inside frame
+*	starts new one. Each request is paired with its response (DS2 - same address and ack byte, KWP - swapped
+*	target and source) and record goes to lock free ring, so TFT/SD in loop can take them at own pace.
+
+*	Timestamps are micros() of first byte of each frame. Bytes read in one go are backdated by byte time from
+	moment of reading, so they stay accurate as long as service() runs before RX buffer wraps.
+*	On ESP32 begin() starts task on core 0 which keeps reading serial (thread on host build), loop() only calls read().
+
+*	Usage:
+	uint8_t ring[4096], recordData[DS2_SNIFF_RECORD];
+	DS2Sniffer sniffer(Serial2, ring, sizeof(ring));
+	sniffer.begin();
+	DS2SniffRecord record;
+	while(sniffer.read(record, recordData)) { ... record.request, record.response ... }
+**/
+
+#ifndef DS2Sniffer_h
+#define DS2Sniffer_h
+
+#include "DS2.h"
+
+#if defined(DS2_HOST)
+	#include <thread>
+#endif
+
+// Gap between bytes which ends frame that's not complete yet, us
+#ifndef DS2_SNIFF_GAP
+#define DS2_SNIFF_GAP 20000UL
+#endif
+
+#define DS2_SNIFF_HEADER 10
+#define DS2_SNIFF_RECORD 510 // request + response, data passed to read() needs this much
+
+
+struct DS2SniffRecord {
+	uint32_t requestAt, responseAt; // micros of first byte, 0 if there was none
+	// responseLength 0 - request got no answer. Frame that doesn't answer pending request is stored as request,
+	//	so response without request ends up there too
+	uint8_t requestLength, responseLength;
+	const uint8_t *request;
+	const uint8_t *response;
+};
+
+
+class DS2Sniffer {
+	public:
+		DS2Sniffer(Stream &serial, uint8_t buffer[], uint32_t size):serial(serial), buffer(buffer), size(size) {}
+		~DS2Sniffer() { end(); } // task must not outlive us
+		
+		// On ESP32 and host reads serial from background task unless task is false
+		void begin(bool task = true);
+		void end();
+		void setKwp(bool kwpSet) { kwp = kwpSet; }
+		void setBaud(uint32_t baud) { byteTime = (11000000UL + baud - 1) / baud; } // 8E1
+		void setTimeout(uint32_t timeoutMs) { timeout = timeoutMs * 1000; } // request without response after it is recorded alone
+		
+		// Producer - reads everything waiting in serial, call often in loop if there is no task
+		void service();
+		// Consumer - copies oldest record into data (DS2_SNIFF_RECORD bytes), false if there is none
+		bool read(DS2SniffRecord &record, uint8_t data[]);
+		
+		uint32_t getFrames() { return frames; }
+		uint32_t getPairs() { return pairs; }
+		uint32_t getDiscarded() { return discarded; } // bytes dropped while resyncing
+		uint32_t getDropped() { return dropped; } // records lost because ring was full
+		void resetCounters();
+		
+	private:
+		Stream &serial;
+		uint8_t *buffer;
+		uint32_t size;
+		volatile uint32_t head = 0, tail = 0; // free running ring positions
+		volatile bool running = false;
+		bool kwp = false;
+		uint32_t byteTime = 1146; // 9600 8E1
+		uint32_t timeout = ISO_TIMEOUT * 1000UL;
+		
+		DS2Parser parser;
+		uint8_t frame[256];
+		uint8_t retry[256]; // bytes to parse again after resync
+		uint32_t frameAt = 0, lastByteAt = 0;
+		
+		uint8_t request[256];
+		uint8_t requestLength = 0;
+		uint32_t requestAt = 0;
+		
+		volatile uint32_t frames = 0, pairs = 0, discarded = 0, dropped = 0;
+		
+#if defined(ESP32)
+		TaskHandle_t task = nullptr;
+		volatile bool taskDone = true;
+		static void readerTask(void *sniffer);
+#elif defined(DS2_HOST)
+		std::thread thread;
+#endif
+		
+		void feed(uint8_t value, uint32_t at);
+		void frameDone(uint8_t length);
+		bool isResponse(const uint8_t response[]);
+		void record(uint32_t reqAt, const uint8_t req[], uint8_t reqLength, uint32_t respAt, const uint8_t resp[], uint8_t respLength);
+		void put(uint32_t position, const uint8_t bytes[], uint32_t length);
+		void get(uint32_t position, uint8_t bytes[], uint32_t length);
+};
+
+#endif /* DS2Sniffer_h */
@@ -0,0 +1,153 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DS2Stats.h"
+
+
+uint8_t DS2CommandStats::bucket(uint32_t latencyUs) {
+	uint32_t units = latencyUs >> 7;
+	if(units < 4) return units;
+	uint8_t octave = 2;
+	while(units >> (octave + 1)) octave++;
+	uint8_t index = (octave - 1) * 4 + ((units >> (octave - 2)) & 3);
+	return index < DS2_STATS_BUCKETS ? index : DS2_STATS_BUCKETS - 1;
+}
+
+uint32_t DS2CommandStats::bucketStart(uint8_t bucket) {
+	if(bucket < 4) return (uint32_t) bucket << 7;
+	uint8_t octave = bucket / 4 + 1;
+	return ((uint32_t) (4 + bucket % 4) << (octave - 2)) << 7;
+}
+
+uint32_t DS2CommandStats::getSamples() const {
+	uint32_t samples = 0;
+	for(uint8_t i = 0; i < DS2_STATS_BUCKETS; i++) samples += buckets[i];
+	return samples;
+}
+
+uint32_t DS2CommandStats::getPercentile(uint8_t percent) const {
+	uint32_t samples = getSamples();
+	if(samples == 0) return 0;
+	uint32_t target = (uint64_t) samples * percent / 100;
+	if(target == 0) target = 1;
+	uint32_t count = 0;
+	for(uint8_t i = 0; i < DS2_STATS_BUCKETS; i++) {
+		count += buckets[i];
+		if(count < target) continue;
+		if(i == DS2_STATS_BUCKETS - 1) return maxLatency;
+		uint32_t middle = (bucketStart(i) + bucketStart(i + 1)) / 2;
+		return middle < maxLatency ? middle : maxLatency;
+	}
+	return maxLatency;
+}
+
+
+
+void DS2Stats::sent(uint16_t hash) {
+	beginWrite();
+	current = entry(hash);
+	if(current != DS2_STATS_NONE) commands[current].requests++;
+	total.requests++;
+	corrupted = false;
+	sentAt = micros();
+	endWrite();
+}
+
+void DS2Stats::received(ReceiveType type, uint8_t ack, bool kwp) {
+	if(type == RECEIVE_WAITING) return;
+	if(type == RECEIVE_TIMEOUT && corrupted) type = RECEIVE_BAD;
+	uint32_t latency = micros() - sentAt;
+	bool nak = type == RECEIVE_BAD && ack == (kwp ? 0x7F : 0xB0);
+	uint8_t index = DS2CommandStats::bucket(latency);
+	beginWrite();
+	if(current != DS2_STATS_NONE) add(commands[current], type, nak, index, latency);
+	add(total, type, nak, index, latency);
+	endWrite();
+}
+
+void DS2Stats::frameError(uint8_t discardedBytes, bool checksumError) {
+	if(discardedBytes == 0 && !checksumError) return;
+	beginWrite();
+	discarded += discardedBytes;
+	if(checksumError) {
+		corrupted = true;
+		if(current != DS2_STATS_NONE) commands[current].checksumErrors++;
+		total.checksumErrors++;
+	}
+	endWrite();
+}
+
+void DS2Stats::add(DS2CommandStats &stats, ReceiveType type, bool nak, uint8_t bucket, uint32_t latency) {
+	if(type == RECEIVE_TIMEOUT) {
+		stats.timeouts++;
+		return;
+	}
+	if(type == RECEIVE_OK) stats.ok++;
+	else stats.bad++;
+	if(nak) stats.naks++;
+	stats.buckets[bucket]++;
+	if(latency > stats.maxLatency) stats.maxLatency = latency;
+}
+
+uint8_t DS2Stats::entry(uint16_t hash) {
+	for(uint8_t i = 0; i < DS2_STATS_COMMANDS; i++) {
+		if(commands[i].hash == hash) return i;
+		if(commands[i].hash == 0) {
+			commands[i].hash = hash;
+			return i;
+		}
+	}
+	return DS2_STATS_NONE;
+}
+
+uint8_t DS2Stats::find(const uint8_t command[], bool kwp) const {
+	uint16_t hash = ds2CommandHash(command, kwp);
+	for(uint8_t i = 0; i < DS2_STATS_COMMANDS && commands[i].hash != 0; i++) {
+		if(commands[i].hash == hash) return i;
+	}
+	return DS2_STATS_NONE;
+}
+
+uint8_t DS2Stats::getCommandCount() const {
+	uint8_t count = 0;
+	while(count < DS2_STATS_COMMANDS && commands[count].hash != 0) count++;
+	return count;
+}
+
+bool DS2Stats::snapshot(DS2Stats &copy) const {
+	for(uint8_t attempt = 0; attempt < 8; attempt++) {
+		uint32_t start = sequence;
+		if(start & 1) continue;
+		DS2_BARRIER();
+		memcpy(copy.commands, commands, sizeof(commands));
+		copy.total = total;
+		copy.discarded = discarded;
+		DS2_BARRIER();
+		if(sequence == start) return true;
+	}
+	return false;
+}
+
+void DS2Stats::reset() {
+	beginWrite();
+	memset(commands, 0, sizeof(commands));
+	memset(&total, 0, sizeof(total));
+	discarded = 0;
+	current = DS2_STATS_NONE;
+	corrupted = false;
+	sentAt = 0;
+	endWrite();
+}
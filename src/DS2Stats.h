@@ -0,0 +1,111 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Stats
+*	Per command latency histogram and error counters, so tail latency, timeouts, NAKs and noise on the line
+*	are visible instead of single responses per second number.
+
+*	Latency is measured from command write to complete response and kept in log buckets - 4 per octave
+	starting at 128 us, so percentiles are within ~12%. Last bucket collects everything above ~1 s.
+*	Commands are told apart by hash of their bytes, first DS2_STATS_COMMANDS distinct ones get own entry,
+	all of them go into total.
+*	Not built in by default, build with -DDS2_STATS=1 to add it to DS2 (~2 KB of RAM per DS2 instance).
+
+*	Usage:
+	DS2Stats copy;
+	DS2.getStats().snapshot(copy); // safe while other task drives the bus
+	copy.getTotal().getPercentile(99);
+	DS2.getStats().reset();
+**/
+
+#ifndef DS2Stats_h
+#define DS2Stats_h
+
+#include "DS2Frame.h"
+#include "DS2Parser.h"
+
+// Off unless asked for - costs about 2 KB of RAM in every DS2 (224 bytes per DS2_STATS_COMMANDS entry plus total)
+#ifndef DS2_STATS
+#define DS2_STATS 0
+#endif
+
+#if DS2_STATS
+	#define DS2_STAT(x) x
+#else
+	#define DS2_STAT(x)
+#endif
+
+// Commands with own histogram, each takes 224 bytes
+#ifndef DS2_STATS_COMMANDS
+#define DS2_STATS_COMMANDS 8
+#endif
+
+#define DS2_STATS_BUCKETS 48
+#define DS2_STATS_NONE 0xFF
+
+
+struct DS2CommandStats {
+	uint16_t hash; // 0 - entry not used
+	uint32_t requests, ok, timeouts, bad;
+	uint32_t naks; // response with negative ack (B0, KWP 7F), counted in bad too
+	uint32_t checksumErrors; // frames dropped because of checksum, request is counted as bad
+	uint32_t maxLatency; // us
+	uint32_t buckets[DS2_STATS_BUCKETS];
+	
+	uint32_t getPercentile(uint8_t percent) const; // us, middle of bucket
+	uint32_t getSamples() const; // responses with latency
+	
+	static uint8_t bucket(uint32_t latencyUs);
+	static uint32_t bucketStart(uint8_t bucket); // us
+};
+
+
+class DS2Stats {
+	public:
+		DS2Stats():sequence(0) { reset(); }
+		
+		// Hooks called by DS2
+		void sent(uint16_t hash); // ds2CommandHash of command
+		void received(ReceiveType type, uint8_t ack, bool kwp);
+		void frameError(uint8_t discardedBytes, bool checksumError);
+		
+		// Copies all counters, retries if DS2 updated them meanwhile; false if it was too busy
+		bool snapshot(DS2Stats &copy) const;
+		void reset(); // call from task which drives the bus or while it's idle
+		
+		const DS2CommandStats &getTotal() const { return total; }
+		uint8_t getCommandCount() const;
+		const DS2CommandStats &getCommand(uint8_t index) const { return commands[index]; }
+		uint8_t find(const uint8_t command[], bool kwp) const; // DS2_STATS_NONE if not tracked
+		uint32_t getDiscarded() const { return discarded; } // bytes skipped while resyncing on device byte
+		
+	private:
+		DS2CommandStats commands[DS2_STATS_COMMANDS];
+		DS2CommandStats total;
+		uint32_t discarded;
+		uint32_t sentAt;
+		uint8_t current; // entry of command on the bus
+		bool corrupted; // current response failed checksum, so its timeout is really bad response
+		volatile uint32_t sequence; // odd while counters are written
+		
+		uint8_t entry(uint16_t hash);
+		void add(DS2CommandStats &stats, ReceiveType type, bool nak, uint8_t bucket, uint32_t latency);
+		void beginWrite() { sequence++; DS2_BARRIER(); }
+		void endWrite() { DS2_BARRIER(); sequence++; }
+};
+
+#endif /* DS2Stats_h */
@@ -0,0 +1,265 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include <DS2Telemetry.h>
+
+
+bool DS2Telemetry::begin(Print &output, bool useTask) {
+	if(size == 0) return false;
+	end();
+	out = &output;
+	head = tail = 0;
+	schemaPending = true;
+	sequence = 0;
+	skip = 0;
+	pendingMask = 0;
+	running = true;
+#if defined(ESP32)
+	if(useTask) {
+		taskDone = false;
+		// Core 0 - Arduino loop runs on core 1
+		if(xTaskCreatePinnedToCore(writerTask, "DS2Telemetry", 4096, this, 1, &task, 0) != pdPASS) {
+			task = nullptr;
+			taskDone = true;
+		}
+	}
+#else
+	(void) useTask;
+#endif
+	return true;
+}
+
+void DS2Telemetry::end() {
+	if(!running) return;
+	running = false;
+#if defined(ESP32)
+	while(!taskDone) delay(1);
+	task = nullptr;
+#endif
+}
+
+void DS2Telemetry::put(uint32_t position, const uint8_t bytes[], uint16_t length) {
+	uint32_t index = position % size;
+	uint32_t first = size - index;
+	if(first > length) first = length;
+	memcpy(buffer + index, bytes, first);
+	memcpy(buffer, bytes + first, length - first);
+}
+
+void DS2Telemetry::publish(uint32_t length) {
+	DS2_BARRIER();
+	head = head + length;
+	if(head - tail > highWater) highWater = head - tail;
+}
+
+bool DS2Telemetry::queueSchema() {
+	uint8_t count = getCount();
+	uint32_t bodyLength = 2;
+	for(uint8_t i = 0; i < count; i++) {
+		size_t nameLength = strlen(table.getChannel(i).name);
+		bodyLength += 4 + (nameLength < 255 ? nameLength : 255);
+	}
+	uint32_t total = DS2_TELEMETRY_HEADER + bodyLength + 1;
+	if(bodyLength > 0xFFFF || head - tail + total > size) return false;
+	
+	// Goes to queue in pieces, names stay where they are
+	uint8_t checksum = 0;
+	uint32_t position = head;
+	uint8_t header[DS2_TELEMETRY_HEADER + 2] = {DS2_TELEMETRY_SYNC, DS2_TELEMETRY_SCHEMA, (uint8_t) bodyLength, (uint8_t) (bodyLength >> 8),
+			DS2_TELEMETRY_VERSION, count};
+	put(position, header, sizeof(header));
+	position += sizeof(header);
+	for(uint8_t i = 0; i < sizeof(header); i++) checksum ^= header[i];
+	for(uint8_t i = 0; i < count; i++) {
+		const DS2Channel &channel = table.getChannel(i);
+		size_t length = strlen(channel.name);
+		uint8_t nameLength = length < 255 ? length : 255;
+		uint8_t description[4] = {channel.shift, channel.flags, channel.width, nameLength};
+		put(position, description, sizeof(description));
+		put(position + sizeof(description), (const uint8_t *) channel.name, nameLength);
+		position += sizeof(description) + nameLength;
+		for(uint8_t j = 0; j < sizeof(description); j++) checksum ^= description[j];
+		for(uint8_t j = 0; j < nameLength; j++) checksum ^= (uint8_t) channel.name[j];
+	}
+	put(position, &checksum, 1);
+	publish(total);
+	schemaPending = false;
+	schemaAt = millis();
+	return true;
+}
+
+bool DS2Telemetry::push(const DS2Frame &frame) {
+	int32_t values[DS2_TELEMETRY_CHANNELS];
+	uint8_t count = getCount();
+	for(uint8_t i = 0; i < count; i++) values[i] = table.getValue(frame, i);
+	return push(count == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << count) - 1, values, frame.getTimeStamp());
+}
+
+bool DS2Telemetry::push(uint64_t mask, const int32_t values[], uint32_t timeStamp) {
+	samples++;
+	uint16_t number = sequence++;
+	if(!running) return false;
+	if(schemaPending || (schemaInterval != 0 && millis() - schemaAt >= schemaInterval)) queueSchema();
+	
+	uint8_t count = getCount();
+	if(count < 64) mask &= ((uint64_t) 1 << count) - 1;
+	mask |= pendingMask;
+	if(mask == 0) return true;
+	
+	// Fuller queue - fewer samples
+	uint32_t used = head - tail;
+	uint8_t step = 1;
+	if(used >= size / 2) step = 2;
+	if(used >= size / 4 * 3) step = 4;
+	if(used >= size / 8 * 7) step = 8;
+	if(++skip < step) {
+		decimated++;
+		pendingMask = mask;
+		return false;
+	}
+	skip = 0;
+	
+	uint8_t message[DS2_TELEMETRY_DATA_MAX];
+	uint8_t maskLength = (count + 7) / 8;
+	uint16_t length = DS2_TELEMETRY_HEADER;
+	message[length++] = (uint8_t) number;
+	message[length++] = (uint8_t) (number >> 8);
+	for(uint8_t i = 0; i < 4; i++) message[length++] = (uint8_t) (timeStamp >> (8 * i));
+	message[length++] = maskLength;
+	for(uint8_t i = 0; i < maskLength; i++) message[length++] = (uint8_t) (mask >> (8 * i));
+	for(uint8_t i = 0; i < count; i++) {
+		if(!(mask >> i & 1)) continue;
+		uint32_t value = (uint32_t) values[i];
+		for(uint8_t j = 0; j < 4; j++) message[length++] = (uint8_t) (value >> (8 * j));
+	}
+	uint16_t bodyLength = length - DS2_TELEMETRY_HEADER;
+	message[0] = DS2_TELEMETRY_SYNC;
+	message[1] = DS2_TELEMETRY_DATA;
+	message[2] = (uint8_t) bodyLength;
+	message[3] = (uint8_t) (bodyLength >> 8);
+	uint8_t checksum = 0;
+	for(uint16_t i = 0; i < length; i++) checksum ^= message[i];
+	message[length++] = checksum;
+	
+	if(used + length > size) {
+		dropped++;
+		pendingMask = mask;
+		return false;
+	}
+	put(head, message, length);
+	publish(length);
+	pendingMask = 0;
+	queued++;
+	return true;
+}
+
+uint32_t DS2Telemetry::service() {
+	if(out == nullptr) return 0;
+	// Stream that doesn't know its free space reports 0, then we write chunk and let it block for that long
+	int room = out->availableForWrite();
+	uint32_t limit = room > 0 ? (uint32_t) room : writeChunk;
+	uint32_t written = 0;
+	while(written < limit && head != tail) {
+		DS2_BARRIER();
+		uint32_t pending = head - tail;
+		uint32_t index = tail % size;
+		uint32_t chunk = size - index; // up to end of ring
+		if(chunk > pending) chunk = pending;
+		if(chunk > limit - written) chunk = limit - written;
+		size_t count = out->write(buffer + index, chunk);
+		DS2_BARRIER();
+		tail = tail + count;
+		written += count;
+		if(count < chunk) break;
+	}
+	bytesWritten += written;
+	return written;
+}
+
+bool DS2Telemetry::parse(const uint8_t data[], uint32_t length, uint32_t &position, DS2TelemetryMessage &message) {
+	while(true) {
+		while(position < length && data[position] != DS2_TELEMETRY_SYNC) position++;
+		if(position + DS2_TELEMETRY_HEADER > length) return false;
+		const uint8_t *header = data + position;
+		uint16_t bodyLength = (uint16_t) header[2] | (uint16_t) header[3] << 8;
+		// Garbage that looks like sync must not make us wait for huge message
+		bool plausible = (header[1] == DS2_TELEMETRY_SCHEMA && bodyLength >= 2)
+				|| (header[1] == DS2_TELEMETRY_DATA && bodyLength >= 7 && bodyLength <= DS2_TELEMETRY_DATA_MAX - DS2_TELEMETRY_HEADER - 1);
+		if(!plausible) {
+			position++;
+			continue;
+		}
+		uint32_t total = DS2_TELEMETRY_HEADER + bodyLength + 1;
+		if(position + total > length) return false;
+		uint8_t checksum = 0;
+		for(uint32_t i = 0; i < total - 1; i++) checksum ^= header[i];
+		const uint8_t *body = header + DS2_TELEMETRY_HEADER;
+		if(checksum != header[total - 1]) {
+			position++;
+			continue;
+		}
+		
+		message.type = header[1];
+		message.length = bodyLength;
+		message.body = body;
+		message.sequence = 0;
+		message.timeStamp = 0;
+		message.mask = 0;
+		if(message.type == DS2_TELEMETRY_DATA) {
+			uint8_t maskLength = body[6];
+			uint8_t count = 0;
+			if(maskLength > 8 || 7 + maskLength > bodyLength) {
+				position++;
+				continue;
+			}
+			for(uint8_t i = 0; i < maskLength; i++) message.mask |= (uint64_t) body[7 + i] << (8 * i);
+			for(uint64_t bits = message.mask; bits; bits &= bits - 1) count++;
+			if(7 + maskLength + 4 * count != bodyLength) {
+				position++;
+				continue;
+			}
+			message.sequence = (uint16_t) body[0] | (uint16_t) body[1] << 8;
+			message.timeStamp = (uint32_t) body[2] | (uint32_t) body[3] << 8 | (uint32_t) body[4] << 16 | (uint32_t) body[5] << 24;
+		}
+		position += total;
+		return true;
+	}
+}
+
+uint8_t DS2Telemetry::getValues(const DS2TelemetryMessage &message, int32_t values[]) {
+	if(message.type != DS2_TELEMETRY_DATA) return 0;
+	const uint8_t *value = message.body + 7 + message.body[6];
+	uint8_t count = 0;
+	for(uint8_t i = 0; i < 64; i++) {
+		if(!(message.mask >> i & 1)) continue;
+		values[i] = (int32_t) ((uint32_t) value[0] | (uint32_t) value[1] << 8 | (uint32_t) value[2] << 16 | (uint32_t) value[3] << 24);
+		value += 4;
+		count++;
+	}
+	return count;
+}
+
+#if defined(ESP32)
+void DS2Telemetry::writerTask(void *parameter) {
+	DS2Telemetry *telemetry = (DS2Telemetry *) parameter;
+	while(telemetry->running) {
+		if(telemetry->service() == 0) vTaskDelay(1);
+	}
+	telemetry->taskDone = true;
+	vTaskDelete(NULL);
+}
+#endif
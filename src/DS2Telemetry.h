@@ -0,0 +1,149 @@
+/*
+Copyright 2020 - Made by sorek.uk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+*	DS2Telemetry
+*	Decoded channel values pushed to phone/PC as framed binary messages, i.e. over BluetoothSerial. App gets schema
+*	with channel names first and then samples, it doesn't have to know DS2 at all.
+*	push() only copies message into RAM queue and returns, poll loop never waits for the link. Queue is drained from
+*	FreeRTOS task on ESP32 (blocking BT write happens there) or from service() in loop, which writes only what
+*	availableForWrite() says link takes (or setWriteChunk bytes if stream doesn't tell).
+*	When link can't keep up samples are decimated - every 2nd when queue is half full, every 4th at 3/4, every 8th
+*	at 7/8 - and dropped when there is no room. Channels of skipped samples go with next sample, so change-only pushes
+*	(DS2ChangeTracker) are not lost, only delayed. Sequence number counts every push, gap tells app how many were skipped.
+
+*	Message format (little endian):
+	-	0xD7 - sync byte
+	-	type - 'S' schema or 'D' data
+	-	length - 2 bytes, body length
+	-	body
+	-	checksum - XOR of all bytes before it
+	Schema body: version, channel count, for each channel shift, flags, width, name length, name (no 0 at end)
+	Data body: sequence (2 bytes), timestamp (4 bytes, micros), mask length, channel mask (bit n - channel n), value of
+		every channel in mask as int32 fixed point with schema shift fraction bits
+
+*	Usage:
+	uint8_t telemetryBuffer[4096];
+	DS2Telemetry telemetry(table, telemetryBuffer, sizeof(telemetryBuffer));
+	telemetry.begin(SerialBT);
+	...
+	if(DS2.receiveData(data) == RECEIVE_OK) telemetry.push(DS2.getFrame());
+**/
+
+#ifndef DS2Telemetry_h
+#define DS2Telemetry_h
+
+#include "DS2Channel.h"
+
+// Channels sent, up to 64
+#ifndef DS2_TELEMETRY_CHANNELS
+	#if defined(__AVR__)
+		#define DS2_TELEMETRY_CHANNELS 16
+	#else
+		#define DS2_TELEMETRY_CHANNELS 64
+	#endif
+#endif
+#if DS2_TELEMETRY_CHANNELS > 64
+	#error "DS2_TELEMETRY_CHANNELS can't be over 64"
+#endif
+
+#define DS2_TELEMETRY_SYNC 0xD7
+#define DS2_TELEMETRY_SCHEMA 'S'
+#define DS2_TELEMETRY_DATA 'D'
+#define DS2_TELEMETRY_VERSION 1
+#define DS2_TELEMETRY_HEADER 4
+// Longest data message
+#define DS2_TELEMETRY_DATA_MAX (DS2_TELEMETRY_HEADER + 7 + 8 + 4 * DS2_TELEMETRY_CHANNELS + 1)
+
+
+struct DS2TelemetryMessage {
+	uint8_t type;
+	uint16_t length; // body
+	const uint8_t *body;
+	// Data only
+	uint16_t sequence;
+	uint32_t timeStamp;
+	uint64_t mask;
+};
+
+
+class DS2Telemetry {
+	public:
+		// Queue for messages, should hold at least few of them. Table is copied, its channels must stay valid
+		DS2Telemetry(const DS2ChannelTable &table, uint8_t buffer[], uint32_t size):table(table), buffer(buffer), size(size) {}
+		
+		// Starts sending to out with schema first; on ESP32 drains from background task unless task is false
+		bool begin(Print &out, bool task = true);
+		void end();
+		
+		// Producer side, single caller. Return false if sample was decimated or dropped
+		bool push(const DS2Frame &frame); // all channels of table
+		bool push(uint64_t mask, const int32_t values[], uint32_t timeStamp); // i.e. DS2ChangeTracker::update result
+		
+		// Schema goes again before next sample, i.e. when app connects
+		void sendSchema() { schemaPending = true; }
+		void setSchemaInterval(uint32_t intervalMs) { schemaInterval = intervalMs; } // 0 - only on begin and sendSchema
+		
+		// Writer side - writes what link takes, call in loop if there is no task. Returns bytes written
+		uint32_t service();
+		// Bytes per service call when availableForWrite() gives 0 - stream doesn't know (default Print) or link is full.
+		//	Set 0 for streams that report real free space, then full link is never written
+		void setWriteChunk(uint16_t bytes) { writeChunk = bytes; }
+		
+		uint32_t getSamples() { return samples; } // pushed
+		uint32_t getQueued() { return queued; }
+		uint32_t getDecimated() { return decimated; }
+		uint32_t getDropped() { return dropped; } // no room in queue
+		uint32_t getUsed() { return head - tail; }
+		uint32_t getHighWater() { return highWater; }
+		uint32_t getBytesWritten() { return bytesWritten; }
+		
+		// Reads message at position from received bytes, skips garbage; false if no complete message, position stays
+		//	at its start so it can be called again with more data
+		static bool parse(const uint8_t data[], uint32_t length, uint32_t &position, DS2TelemetryMessage &message);
+		// Values of data message into values[channel] for channels in mask, returns count
+		static uint8_t getValues(const DS2TelemetryMessage &message, int32_t values[]);
+		
+	private:
+		DS2ChannelTable table; // copy, DS2Profile::getTable() gives temporary
+		uint8_t *buffer;
+		uint32_t size;
+		Print *out = nullptr;
+		volatile uint32_t head = 0, tail = 0; // free running, index is value % size
+		volatile bool running = false;
+		
+		bool schemaPending = true;
+		uint32_t schemaInterval = 5000, schemaAt = 0;
+		uint16_t sequence = 0;
+		uint8_t skip = 0; // samples skipped in current decimation step
+		uint64_t pendingMask = 0; // channels of skipped samples
+		uint16_t writeChunk = 64;
+		
+		volatile uint32_t samples = 0, queued = 0, decimated = 0, dropped = 0, highWater = 0, bytesWritten = 0;
+		
+#if defined(ESP32)
+		TaskHandle_t task = nullptr;
+		volatile bool taskDone = true;
+		static void writerTask(void *telemetry);
+#endif
+		
+		uint8_t getCount() { return table.getCount() < DS2_TELEMETRY_CHANNELS ? table.getCount() : DS2_TELEMETRY_CHANNELS; }
+		bool queueSchema();
+		void put(uint32_t position, const uint8_t bytes[], uint16_t length);
+		void publish(uint32_t length);
+};
+
+#endif /* DS2Telemetry_h */